@@ -18,6 +18,21 @@ Agent::Agent(int aid,  double bite_shape, int age){
     bite_scale = bite_gamma(bite_shape, 1/bite_shape);
 }
 
+//agent whose bite scale is already known (population image)
+Agent::Agent(int aid, int age, double bite_scale){
+    this->aid = aid;
+    this->age = age;
+
+    changed_epi_today = false;
+    status = 'S';
+
+    worm_strength = 0;
+
+    last_mworm_time = - std::numeric_limits<double>::infinity();
+
+    this->bite_scale = bite_scale;
+}
+
 Agent::~Agent(){
     dgp = NULL;
     ngp = NULL;
@@ -28,23 +43,13 @@ Agent::~Agent(){
 
 }
 
-void Agent::sim_bites(double c, double worktonot, bool single){
-    
-    int total_bites;
-
-    if(single){
-        total_bites = poisson(c *  ngp->night_strength * bite_scale);
-    }else{
-        int day_bites;
-        int night_bites;
-        
+void Agent::sim_bites(double rate){
+    add_worms(poisson(rate));
+}
 
-        day_bites  = poisson(c *  dgp->day_strength * bite_scale * worktonot);
-        night_bites = poisson(c * ngp->night_strength * bite_scale * (1.0 - worktonot));
+void Agent::add_worms(int total_bites){
+    if(profiling) prof_counters->bites += total_bites;
 
-        total_bites = day_bites + night_bites;
-    }
-    
     for(int i = 0; i < total_bites; ++i){ //looping through infective bites and assigning worms
         int immature_period = normal(IMMATURE_PERIOD_MEAN, IMMATURE_PERIOD_MEAN_STD); //immature period of worm
         int mature_period = normal(MATURE_PERIOD_MEAN, MATURE_PERIOD_MEAN_STD); //mature period of worm
@@ -143,7 +148,7 @@ void Agent::update(int year, int day, int dt){
 
     //Record if worm has died!
     if((prevstatus == 'U' || prevstatus == 'I') && (status == 'S' || status == 'E')){ // all mature worms have died!
-        last_mworm_time = year * 365 + day*dt;
+        last_mworm_time = year * 365 + day; //day of the year, the clock the antigen checks use
     }
     
 }
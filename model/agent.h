@@ -2,6 +2,7 @@
 #define agent_hpp
 
 #include "params.h"
+#include "profile.h"
 
 #include<iostream>
 
@@ -33,6 +34,12 @@ public:
 
         age_mda = 0;
         mda_sterile = 1.0;
+
+        if(profiling) ++prof_counters->worms_created;
+    }
+
+    ~Worm(){
+        if(profiling) ++prof_counters->worms_destroyed;
     }
 
     void update(int dt);
@@ -61,10 +68,14 @@ public:
     vector<Worm*> wvec;
    
     Agent(int aid, double bite_shape, int age = -1);
+    Agent(int aid, int age, double bite_scale);
 
     ~Agent();
 
-    void sim_bites(double c, double w2n, bool single);
+    void sim_bites(double rate);    //infective bites at rate (day and night are drawn separately)
+    void add_worms(int total_bites);
+
+
     void update(int day, int year, int dt);
     void mda(Drugs drug);
 
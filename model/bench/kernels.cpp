@@ -0,0 +1,294 @@
+// Kernel micro-benchmarks for the model.
+//
+// Builds a Region for each scale in data/Scales/ and times the hot kernels
+// (seed_lf, calc_risk, Agent::update, update_epi_status, renew_pop/handle_birth
+// and radt_model) at fixed seeds. Run from model/ like the main binary:
+//
+//   ./bench/kernels [--scales One,Village] [--reps 5] [--weeks 13] [--seed 1]
+//                   [--json out.json] [--baseline file.json] [--save-baseline]
+//
+// Results are compared against the baseline JSON (if it exists) so an
+// optimisation can be measured in isolation.
+
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+
+#include "../network.h"
+#include "../rng.h"
+
+using namespace std;
+
+extern string prv_out_loc;
+
+struct BenchResult{
+    string scale;
+    string kernel;
+    double seconds;     //median time of one repetition
+    double throughput;  //work units per second
+    string unit;
+};
+
+static double now_s(){
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double median(vector<double> v){
+    sort(v.begin(), v.end());
+    return v[v.size()/2];
+}
+
+static vector<string> split(const string& s, char sep){
+    vector<string> out;
+    stringstream ss(s);
+    string item;
+    while(getline(ss, item, sep)) if(!item.empty()) out.push_back(item);
+    return out;
+}
+
+class Fixture{
+public:
+    Region *rgn;
+    string scale;
+
+    Fixture(const string& data_dir, const string& scale){
+        this->scale = scale;
+        string config_dir = string(CONFIG) + "bench/" + scale + "/";
+        filesystem::create_directories(config_dir);
+
+        rgn = new Region(0, "BENCH", data_dir, data_dir + "Scales/" + scale + "/", config_dir);
+    }
+
+    ~Fixture(){
+        delete rgn;
+    }
+
+    //fresh population with LF seeded and commuters assigned, same state for a given seed
+    void prepare(unsigned seed){
+        seed_rng(seed);
+        rgn->reset_population();
+        rgn->handle_commute(0);
+        rgn->seed_initial_infection();
+    }
+
+    int n_agents(){
+        int n = 0;
+        for(map<int, Group*>::iterator j = rgn->groups.begin(); j != rgn->groups.end(); ++j){
+            n += j->second->group_pop.size();
+        }
+        return n;
+    }
+};
+
+static BenchResult bench_seed(Fixture& fx, int reps, unsigned seed){
+    vector<double> times;
+    double work = 0;
+    for(int r = 0; r < reps; ++r){
+        seed_rng(seed + r);
+        fx.rgn->reset_population();
+        fx.rgn->handle_commute(0);
+
+        uint64_t attempts = prof.counters.seed_attempts;
+        double t0 = now_s();
+        fx.rgn->seed_initial_infection();
+        times.push_back(now_s() - t0);
+        work += (double)fx.n_agents() * (prof.counters.seed_attempts - attempts);
+    }
+    double t = median(times);
+    return {fx.scale, "seed_lf", t, work / reps / t, "agents seeded/s"};
+}
+
+static BenchResult bench_calc_risk(Fixture& fx, int reps, int weeks, unsigned seed){
+    vector<double> times;
+    double work = 0;
+    for(int r = 0; r < reps; ++r){
+        fx.prepare(seed + r);
+        double t0 = now_s();
+        for(int w = 0; w < weeks; ++w) fx.rgn->calc_risk();
+        times.push_back(now_s() - t0);
+        work += (double)fx.n_agents() * weeks;
+    }
+    double t = median(times);
+    return {fx.scale, "calc_risk", t, work / reps / t, "agent-weeks/s"};
+}
+
+static BenchResult bench_agent_update(Fixture& fx, int reps, int weeks, unsigned seed){
+    vector<double> times;
+    double work = 0;
+    for(int r = 0; r < reps; ++r){
+        fx.prepare(seed + r);
+
+        vector<Agent*> infected; //everyone carrying worms
+        for(map<int, Group*>::iterator j = fx.rgn->groups.begin(); j != fx.rgn->groups.end(); ++j){
+            for(map<int, Agent*>::iterator k = j->second->group_pop.begin(); k != j->second->group_pop.end(); ++k){
+                if(k->second->wvec.size() > 0) infected.push_back(k->second);
+            }
+        }
+
+        double worms = 0;
+        double t0 = now_s();
+        for(int w = 0; w < weeks; ++w){
+            for(Agent *agt : infected){
+                worms += agt->wvec.size();
+                agt->update(0, w*7, 7);
+            }
+        }
+        times.push_back(now_s() - t0);
+        work += worms;
+    }
+    double t = median(times);
+    return {fx.scale, "Agent::update", t, work / reps / t, "worms updated/s"};
+}
+
+static BenchResult bench_update_epi(Fixture& fx, int reps, int weeks, unsigned seed){
+    vector<double> times;
+    double work = 0;
+    for(int r = 0; r < reps; ++r){
+        fx.prepare(seed + r);
+        double t0 = now_s();
+        for(int w = 0; w < weeks; ++w) fx.rgn->update_epi_status(0, w*7, 7);
+        times.push_back(now_s() - t0);
+        work += (double)fx.n_agents() * weeks;
+    }
+    double t = median(times);
+    return {fx.scale, "update_epi_status", t, work / reps / t, "agent-weeks/s"};
+}
+
+static BenchResult bench_demography(Fixture& fx, int reps, int weeks, unsigned seed){
+    vector<double> times;
+    double work = 0;
+    int steps = max(1, weeks / 4); //population step is 28 days
+    for(int r = 0; r < reps; ++r){
+        fx.prepare(seed + r);
+        double t0 = now_s();
+        for(int s = 0; s < steps; ++s){
+            fx.rgn->renew_pop(28);
+            fx.rgn->handle_birth(28);
+        }
+        times.push_back(now_s() - t0);
+        work += (double)fx.n_agents() * steps * 4;
+    }
+    double t = median(times);
+    return {fx.scale, "renew_pop+handle_birth", t, work / reps / t, "agent-weeks/s"};
+}
+
+static BenchResult bench_radt(Fixture& fx, int reps, unsigned seed){
+    vector<double> times;
+    double g = fx.rgn->groups.size();
+    for(int r = 0; r < reps; ++r){
+        fx.prepare(seed + r);
+        double t0 = now_s();
+        fx.rgn->radt_model(DISTANCE_TYPE);
+        times.push_back(now_s() - t0);
+    }
+    double t = median(times);
+    return {fx.scale, "radt_model", t, g * g / t, "groups^2/s"};
+}
+
+static void write_json(const string& filename, const vector<BenchResult>& results){
+    ofstream out(filename);
+    if(!out){
+        cout << "Could not open " << filename << endl;
+        return;
+    }
+    //one entry per line so baselines are easy to diff and read back
+    out << "{\"kernels\": [" << endl;
+    for(size_t i = 0; i < results.size(); ++i){
+        const BenchResult& r = results[i];
+        out << "{\"scale\": \"" << r.scale << "\", \"kernel\": \"" << r.kernel
+            << "\", \"seconds\": " << setprecision(9) << r.seconds
+            << ", \"throughput\": " << r.throughput
+            << ", \"unit\": \"" << r.unit << "\"}" << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    out << "]}" << endl;
+}
+
+static string json_string(const string& line, const string& key){
+    size_t p = line.find("\"" + key + "\": \"");
+    if(p == string::npos) return "";
+    p += key.size() + 5;
+    return line.substr(p, line.find('"', p) - p);
+}
+
+static double json_number(const string& line, const string& key){
+    size_t p = line.find("\"" + key + "\": ");
+    if(p == string::npos) return 0;
+    return atof(line.c_str() + p + key.size() + 4);
+}
+
+static map<string, double> read_baseline(const string& filename){
+    map<string, double> base;
+    ifstream in(filename);
+    string line;
+    while(getline(in, line)){
+        string scale = json_string(line, "scale");
+        if(scale.empty()) continue;
+        base[scale + "/" + json_string(line, "kernel")] = json_number(line, "throughput");
+    }
+    return base;
+}
+
+int main(int argc, const char * argv[]){
+    vector<string> scales {"One", "Village", "Many", "Raster660", "Raster220"};
+    int reps = 5;
+    int weeks = 13;
+    unsigned seed = 1;
+    string json_out;
+    string baseline = string(OUTDIR) + "bench_baseline.json";
+    bool save_baseline = false;
+    profiling = true; //seed_lf work is counted in seeding attempts
+
+    for(int i = 1; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "--scales" && i + 1 < argc) scales = split(argv[++i], ',');
+        else if(arg == "--reps" && i + 1 < argc) reps = atoi(argv[++i]);
+        else if(arg == "--weeks" && i + 1 < argc) weeks = atoi(argv[++i]);
+        else if(arg == "--seed" && i + 1 < argc) seed = atoi(argv[++i]);
+        else if(arg == "--json" && i + 1 < argc) json_out = argv[++i];
+        else if(arg == "--baseline" && i + 1 < argc) baseline = argv[++i];
+        else if(arg == "--save-baseline") save_baseline = true;
+        else{
+            cout << "Unknown option: " << arg << endl;
+            return 1;
+        }
+    }
+
+    prv_out_loc = "print"; //nothing is written by the model itself
+
+    vector<BenchResult> results;
+    for(const string& scale : scales){
+
+        cout << "== " << scale << " ==" << endl;
+        Fixture fx(DATADIR, scale);
+
+        results.push_back(bench_seed(fx, reps, seed));
+        results.push_back(bench_calc_risk(fx, reps, weeks, seed));
+        results.push_back(bench_agent_update(fx, reps, weeks, seed));
+        results.push_back(bench_update_epi(fx, reps, weeks, seed));
+        results.push_back(bench_demography(fx, reps, weeks, seed));
+        if(fx.rgn->groups.size() > 1) results.push_back(bench_radt(fx, reps, seed));
+    }
+
+    map<string, double> base = read_baseline(baseline);
+
+    cout << endl << left << setw(12) << "Scale" << setw(24) << "Kernel" << right
+         << setw(12) << "Time (s)" << setw(16) << "Throughput" << "  " << left << setw(18) << "Unit"
+         << right << setw(12) << "vs baseline" << endl;
+    for(const BenchResult& r : results){
+        cout << left << setw(12) << r.scale << setw(24) << r.kernel << right
+             << setw(12) << fixed << setprecision(4) << r.seconds
+             << setw(16) << scientific << setprecision(3) << r.throughput << "  "
+             << left << setw(18) << r.unit << right;
+        map<string, double>::iterator b = base.find(r.scale + "/" + r.kernel);
+        if(b != base.end() && b->second > 0) cout << setw(11) << fixed << setprecision(2) << r.throughput / b->second << "x";
+        cout << endl;
+    }
+    cout.unsetf(ios::floatfield);
+
+    if(!json_out.empty()) write_json(json_out, results);
+    if(save_baseline){
+        write_json(baseline, results);
+        cout << "Saved baseline to " << baseline << endl;
+    }
+    return 0;
+}
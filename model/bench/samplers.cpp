@@ -0,0 +1,134 @@
+// Checks and timings for the samplers in rand_func.cpp.
+//
+// Each sampler is drawn at the parameters the model uses and compared with the
+// std distribution it replaced: a two-sample Kolmogorov-Smirnov test and the
+// first two moments. Then both are timed per draw (the std ones constructed per
+// call, as rand_func.cpp used to). Exits 1 if any check fails.
+//
+//   ./bench/samplers [--n 200000] [--seed 1]
+
+#include <chrono>
+#include <functional>
+#include <math.h>
+
+#include "../params.h"
+#include "../rng.h"
+
+using namespace std;
+
+struct Sampler{
+    string name;
+    function<double()> ours;
+    function<double()> std_version;
+    bool discrete;
+};
+
+//two-sample KS statistic
+static double ks_statistic(vector<double> a, vector<double> b){
+    sort(a.begin(), a.end());
+    sort(b.begin(), b.end());
+    size_t i = 0, j = 0;
+    double d = 0;
+    while(i < a.size() && j < b.size()){
+        double x = min(a[i], b[j]);
+        while(i < a.size() && a[i] == x) ++i; //ties move together, for the discrete samplers
+        while(j < b.size() && b[j] == x) ++j;
+        d = max(d, fabs(i/(double)a.size() - j/(double)b.size()));
+    }
+    return d;
+}
+
+//asymptotic p-value of the KS statistic, conservative for discrete distributions
+static double ks_p_value(double d, int n){
+    double lambda = d*sqrt(n/2.0);
+    double p = 0;
+    for(int k = 1; k <= 100; ++k) p += 2*(k % 2 ? 1 : -1)*exp(-2*k*k*lambda*lambda);
+    return min(1.0, max(0.0, p));
+}
+
+static void moments(const vector<double>& x, double& mean, double& sd){
+    mean = 0;
+    for(double v : x) mean += v;
+    mean /= x.size();
+    double ss = 0;
+    for(double v : x) ss += (v - mean)*(v - mean);
+    sd = sqrt(ss/(x.size() - 1));
+}
+
+static double ns_per_draw(const function<double()>& f, int n){
+    volatile double sink = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < n; ++i) sink = sink + f();
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / n;
+}
+
+int main(int argc, const char *argv[]){
+    int n = 200000;
+    unsigned seed = 1;
+    for(int i = 1; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "--n" && i + 1 < argc) n = atoi(argv[++i]);
+        else if(arg == "--seed" && i + 1 < argc) seed = atoi(argv[++i]);
+        else{
+            cout << "Unknown option: " << arg << endl;
+            return 1;
+        }
+    }
+    seed_rng(seed);
+
+    double bite_shape = 0.1157; //fitted agg_param
+    vector<Sampler> samplers;
+    samplers.push_back({"uniform", random_real,
+                        []{ return uniform_real_distribution<>(0.0, 1.0)(gen); }, false});
+    for(double rate : {0.01, 0.3, 2.0, 8.0, 30.0}){
+        samplers.push_back({"poisson(" + to_string(rate).substr(0, 4) + ")", [rate]{ return (double)poisson(rate); },
+                            [rate]{ return (double)poisson_distribution<int>(rate)(gen); }, true});
+    }
+    samplers.push_back({"normal(immature)", []{ return normal(IMMATURE_PERIOD_MEAN, IMMATURE_PERIOD_MEAN_STD); },
+                        []{ return normal_distribution<double>(IMMATURE_PERIOD_MEAN, IMMATURE_PERIOD_MEAN_STD)(gen); }, false});
+    samplers.push_back({"normal(mature)", []{ return normal(MATURE_PERIOD_MEAN, MATURE_PERIOD_MEAN_STD); },
+                        []{ return normal_distribution<double>(MATURE_PERIOD_MEAN, MATURE_PERIOD_MEAN_STD)(gen); }, false});
+    samplers.push_back({"normal tail", []{ double x = normal(0, 1); return fabs(x) > 3 ? x : 0.0; },
+                        []{ double x = normal_distribution<double>(0, 1)(gen); return fabs(x) > 3 ? x : 0.0; }, false});
+    samplers.push_back({"gamma(bite)", [=]{ return bite_gamma(bite_shape, 1/bite_shape); },
+                        [=]{ return gamma_distribution<double>(bite_shape, 1/bite_shape)(gen); }, false});
+    for(double shape : {1.0, 3.5}){
+        samplers.push_back({"gamma(" + to_string(shape).substr(0, 3) + ")", [shape]{ return bite_gamma(shape, 1); },
+                            [shape]{ return gamma_distribution<double>(shape, 1)(gen); }, false});
+    }
+    samplers.push_back({"beta(1,4)", []{ return init_beta(1, 4); },
+                        []{ double x = gamma_distribution<>(1, 1)(gen), y = gamma_distribution<>(4, 1)(gen); return x/(x + y); }, false});
+
+    bool ok = true;
+    cout << left << setw(18) << "sampler" << right << setw(12) << "mean" << setw(12) << "std mean"
+         << setw(10) << "sd" << setw(10) << "std sd" << setw(10) << "KS p" << setw(10) << "ns" << setw(10) << "std ns" << setw(9) << "speedup" << endl;
+    for(const Sampler& s : samplers){
+        vector<double> a(n), b(n);
+        for(int i = 0; i < n; ++i) a[i] = s.ours();
+        for(int i = 0; i < n; ++i) b[i] = s.std_version();
+
+        double p = ks_p_value(ks_statistic(a, b), n);
+        double ma, sa, mb, sb;
+        moments(a, ma, sa);
+        moments(b, mb, sb);
+        double se = sqrt((sa*sa + sb*sb)/n);
+        bool pass = p > 1e-3 && fabs(ma - mb) < 4*se + 1e-12;
+        ok = ok && pass;
+
+        double t_ours = ns_per_draw(s.ours, n), t_std = ns_per_draw(s.std_version, n);
+        cout << left << setw(18) << s.name << right << fixed
+             << setprecision(4) << setw(12) << ma << setw(12) << mb << setw(10) << sa << setw(10) << sb
+             << setprecision(3) << setw(10) << p << setprecision(1) << setw(10) << t_ours << setw(10) << t_std
+             << setprecision(2) << setw(8) << t_std/t_ours << "x" << (pass ? "" : "  FAIL") << endl;
+    }
+
+    //bulk fills against one call per draw
+    vector<double> buf(n);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    fill_uniform(buf.data(), n);
+    double t_bulk = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / n;
+    cout << "fill_uniform " << setprecision(1) << t_bulk << " ns per draw" << endl;
+
+    cout << (ok ? "All samplers agree with std" : "Some samplers differ from std") << endl;
+    return ok ? 0 : 1;
+}
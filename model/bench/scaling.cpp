@@ -0,0 +1,165 @@
+// Scaling stress benchmark on synthetic scales.
+//
+// For each groups:population size, writes a synthetic scale (tools/synth.h),
+// then in a forked child builds the Region and simulates a few years,
+// reporting start-up time, seeding time, time per simulated year and peak RSS.
+// Run from model/ like the main binary:
+//
+//   ./bench/scaling [--sizes 1000:200000,5000:1000000] [--years 2] [--layout clustered]
+//                   [--seed 1] [--with-distance-files] [--json out.json]
+
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../network.h"
+#include "../rng.h"
+#include "../tools/synth.h"
+
+using namespace std;
+
+extern string out_path;
+
+struct ScalingResult{
+    int groups;
+    long population;
+    double startup;     //Region construction (first population build, distances)
+    double seeding;     //seed_lf retries in year 0
+    double per_year;    //mean time per simulated year, excluding seeding
+    double peak_rss_mb;
+};
+
+static double now_s(){
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//runs in the child so peak RSS belongs to this size only
+static ScalingResult run_size(const SynthSpec& spec, int years){
+    ScalingResult res {spec.groups, spec.population, 0, 0, 0, 0};
+
+    string dir = string(CONFIG) + "bench/synth_" + to_string(spec.groups) + "_" + to_string(spec.population) + "/";
+    write_synthetic_scale(spec, dir);
+    filesystem::remove_all(dir + "cache/");
+    filesystem::create_directories(dir + "cache/");
+
+    seed_rng(spec.seed);
+    double t0 = now_s();
+    Region *rgn = new Region(0, "SYNTH", dir, dir, dir + "cache/");
+    rgn->reset_population(); //bite scales need the read parameters
+    res.startup = now_s() - t0;
+
+    Drugs drug;
+    MDAStrat strat {0.0, drug, 2, START_YEAR + SIM_YEARS, 0, 1, 1}; //no MDA
+
+    double total = 0;
+    for(int year = 0; year < years; ++year){
+        uint64_t seed_ns = prof.phase[PHASE_SEED_LF].ns;
+        t0 = now_s();
+        rgn->sim(year, strat);
+        total += now_s() - t0;
+        res.seeding += (prof.phase[PHASE_SEED_LF].ns - seed_ns) * 1e-9;
+    }
+    res.per_year = (total - res.seeding) / years;
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    res.peak_rss_mb = usage.ru_maxrss / 1024.0; //kilobytes on linux
+
+    filesystem::remove(out_path);
+    return res;
+}
+
+int main(int argc, const char * argv[]){
+    vector<pair<int, long>> sizes {{250, 50000}, {1000, 200000}, {2500, 500000}, {5000, 1000000}};
+    int years = 2;
+    SynthSpec base;
+    base.euclid_file = base.road_file = false; //dense CSVs get huge, the model uses coordinates instead
+    string json_out;
+    profiling = true; //seeding time comes from the seed_lf phase
+
+    for(int i = 1; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "--sizes" && i + 1 < argc){
+            sizes.clear();
+            stringstream ss(argv[++i]);
+            string item;
+            while(getline(ss, item, ',')){
+                size_t colon = item.find(':');
+                sizes.push_back(pair<int, long>(atoi(item.substr(0, colon).c_str()), atol(item.substr(colon + 1).c_str())));
+            }
+        }
+        else if(arg == "--years" && i + 1 < argc) years = atoi(argv[++i]);
+        else if(arg == "--layout" && i + 1 < argc) base.layout = argv[++i];
+        else if(arg == "--seed" && i + 1 < argc) base.seed = atoi(argv[++i]);
+        else if(arg == "--with-distance-files") base.euclid_file = base.road_file = true;
+        else if(arg == "--json" && i + 1 < argc) json_out = argv[++i];
+        else{
+            cout << "Unknown option: " << arg << endl;
+            return 1;
+        }
+    }
+
+    vector<ScalingResult> results;
+    for(const pair<int, long>& size : sizes){
+        SynthSpec spec = base;
+        spec.groups = size.first;
+        spec.population = size.second;
+        cout << "== " << spec.groups << " groups, " << spec.population << " people ==" << endl;
+
+        int fd[2];
+        if(pipe(fd) != 0){
+            cout << "pipe failed" << endl;
+            return 1;
+        }
+        pid_t pid = fork();
+        if(pid == 0){
+            close(fd[0]);
+            if(!freopen("/dev/null", "w", stdout)) return 1; //the model's yearly prints
+            out_path = string(OUTDIR) + "bench_scaling_" + to_string(getpid()) + ".csv";
+
+            ScalingResult res = run_size(spec, years);
+            if(write(fd[1], &res, sizeof(res)) != sizeof(res)) _exit(1);
+            close(fd[1]);
+            _exit(0);
+        }
+        close(fd[1]);
+        ScalingResult res;
+        ssize_t got = read(fd[0], &res, sizeof(res));
+        close(fd[0]);
+        int status;
+        waitpid(pid, &status, 0);
+        if(got != sizeof(res)){
+            cout << "  failed (exit status " << status << ")" << endl;
+            continue;
+        }
+        results.push_back(res);
+    }
+
+    cout << endl << right << setw(8) << "Groups" << setw(12) << "Population" << setw(14) << "Startup (s)"
+         << setw(14) << "Seeding (s)" << setw(14) << "s/year" << setw(18) << "agent-weeks/s" << setw(16) << "Peak RSS (MB)" << endl;
+    for(const ScalingResult& r : results){
+        cout << setw(8) << r.groups << setw(12) << r.population
+             << fixed << setprecision(2)
+             << setw(14) << r.startup << setw(14) << r.seeding << setw(14) << r.per_year
+             << setw(18) << scientific << setprecision(3) << r.population * 52.0 / r.per_year
+             << setw(16) << fixed << setprecision(1) << r.peak_rss_mb << endl;
+    }
+    cout.unsetf(ios::floatfield);
+
+    if(!json_out.empty()){
+        ofstream out(json_out);
+        out << "{\"years\": " << years << ", \"layout\": \"" << base.layout << "\", \"sizes\": [" << endl;
+        for(size_t i = 0; i < results.size(); ++i){
+            const ScalingResult& r = results[i];
+            out << "{\"groups\": " << r.groups << ", \"population\": " << r.population
+                << ", \"startup_s\": " << r.startup << ", \"seeding_s\": " << r.seeding
+                << ", \"seconds_per_year\": " << r.per_year << ", \"peak_rss_mb\": " << r.peak_rss_mb << "}"
+                << (i + 1 < results.size() ? "," : "") << endl;
+        }
+        out << "]}" << endl;
+    }
+    return 0;
+}
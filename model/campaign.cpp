@@ -0,0 +1,531 @@
+#include "campaign.h"
+#include "rng.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <math.h>
+
+#include <sstream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+extern int sim_i;
+extern string out_path;
+
+vector<Shard> plan_shards(const string& mda_data, int shard_size){
+    vector<Shard> shards;
+    int n_scenarios = count_mda_scenarios(mda_data);
+    int sim_offset = 0;
+
+    for(int s = 0; s < n_scenarios; ++s){
+        MDAStrat strategy = get_mda_strat(mda_data, s + 1);
+        for(int first = 0; first < strategy.n_sims; first += shard_size){
+            int last = min(first + shard_size, strategy.n_sims);
+            shards.push_back(Shard {(int)shards.size(), s, first, last, sim_offset});
+        }
+        sim_offset += strategy.n_sims;
+    }
+    return shards;
+}
+
+double mf_prevalence(Region *rgn){
+    double pop = 0;
+    for(map<int, Group*>::iterator j = rgn->groups.begin(); j != rgn->groups.end(); ++j) pop += j->second->population();
+    return pop > 0 ? rgn->status_count('I')/pop : 0;
+}
+
+void ScenarioRun::add(Region *rgn){
+    double prev = mf_prevalence(rgn);
+    ++n;
+    if(prev == 0) ++n_elim;
+    prev_sum += prev;
+    prev_sum_sq += prev*prev;
+}
+
+double ScenarioRun::elim_half() const {
+    if(n == 0) return 1;
+    const double z = 1.96;
+    double p = elim();
+    return z*sqrt(p*(1 - p)/n + z*z/(4.0*n*n))/(1 + z*z/n);
+}
+
+double ScenarioRun::prev_half() const {
+    if(n < 2) return 1;
+    double var = max(0.0, (prev_sum_sq - prev_sum*prev_sum/n)/(n - 1));
+    return 1.96*sqrt(var/n);
+}
+
+bool ScenarioRun::precise() const {
+    if(STOP_ELIM_WIDTH <= 0 && STOP_PREV_WIDTH <= 0) return false;
+    if(n < STOP_MIN_SIMS) return false;
+    return (STOP_ELIM_WIDTH <= 0 || elim_half() <= STOP_ELIM_WIDTH) && (STOP_PREV_WIDTH <= 0 || prev_half() <= STOP_PREV_WIDTH);
+}
+
+ScenarioRun run_replicates(Region *rgn, MDAStrat& strategy, const Shard& shard, bool may_stop){
+    ScenarioRun run;
+    for(int i = shard.rep_first; i < shard.rep_last; ++i){
+        sim_i = shard.sim_offset + i;
+        seed_replicate(shard.scenario, i);
+
+        //resetting the populations from previous simulation
+        rgn->replicate = i;
+        rgn->reset_population();
+
+        //run run the simulation year by year
+        for(int year = 0; year < SIM_YEARS; ++year){
+            rgn->sim(year, strategy);
+        }
+        ++prof.replicates;
+
+        run.add(rgn);
+        if(may_stop && run.precise()) break;
+    }
+    return run;
+}
+
+static string shard_name(int id){
+    ostringstream name;
+    name << "shard_" << setw(4) << setfill('0') << id;
+    return name.str();
+}
+
+static string worker_tag(){
+    char host[256];
+    if(gethostname(host, sizeof(host)) != 0) strcpy(host, "localhost");
+    host[sizeof(host) - 1] = '\0';
+    return string(host) + "@" + to_string(getpid());
+}
+
+//campaign.txt holds what every worker must agree on
+static void write_campaign(const string& dir, const string& mda_data, int n_shards, Region *rgn){
+    ofstream out(dir + "campaign.txt");
+    out << "seed=" << base_seed << endl;
+    out << "crn=" << crn << endl;
+    out << "mda=" << filesystem::absolute(mda_data).string() << endl;
+    out << "shards=" << n_shards << endl;
+    out << "epi_tol=" << rgn->epi_tol << endl;
+    out << "scale=" << filesystem::absolute(rgn->scale_dir).string() << endl;
+    out << "params=" << filesystem::absolute(rgn->tran_file).string() << endl;
+    out << "set=" << rgn->settings << endl;
+}
+
+static bool read_settings(const string& dir, map<string, string>& settings){
+    ifstream in(dir + "campaign.txt");
+    if(!in) return false;
+
+    string line;
+    while(getline(in, line)){
+        size_t eq = line.find('=');
+        if(eq == string::npos) continue;
+        settings[line.substr(0, eq)] = line.substr(eq + 1);
+    }
+    return true;
+}
+
+static bool read_campaign(const string& dir, string& mda_data, int& n_shards, double& epi_tol){
+    map<string, string> settings;
+    if(!read_settings(dir, settings)) return false;
+
+    if(settings.count("seed")) base_seed = stoull(settings["seed"]);
+    if(settings.count("crn")) crn = settings["crn"] == "1";
+    if(settings.count("mda")) mda_data = settings["mda"];
+    if(settings.count("shards")) n_shards = atoi(settings["shards"].c_str());
+    if(settings.count("epi_tol")) epi_tol = atof(settings["epi_tol"].c_str());
+    return true;
+}
+
+bool campaign_inputs(const string& dir, string& scale_dir, string& tran_file){
+    map<string, string> settings;
+    if(!read_settings(dir, settings)) return false;
+
+    //campaigns from before --scale ran on data/
+    if(settings.count("scale")) scale_dir = settings["scale"];
+    if(settings.count("params")) tran_file = settings["params"];
+    return true;
+}
+
+static bool run_job(Region *rgn, const string& dir, const string& claimed, const string& mda_data){
+    ifstream in(claimed);
+    Shard shard;
+    if(!(in >> shard.id >> shard.scenario >> shard.rep_first >> shard.rep_last >> shard.sim_offset)){
+        cout << "Bad shard file " << claimed << endl;
+        return false;
+    }
+    in.close();
+
+    string part = dir + "parts/" + shard_name(shard.id) + ".csv";
+    out_path = part + ".tmp";
+    filesystem::remove(out_path); //left over from a worker that died
+
+    MDAStrat strategy = get_mda_strat(mda_data, shard.scenario + 1);
+    run_replicates(rgn, strategy, shard);
+
+    filesystem::rename(out_path, part);
+    ofstream(dir + "done/" + shard_name(shard.id)) << worker_tag() << endl;
+    filesystem::remove(claimed);
+    return true;
+}
+
+int run_worker(Region *rgn, const string& dir){
+    string mda_data;
+    int n_shards = 0;
+    if(!read_campaign(dir, mda_data, n_shards, rgn->epi_tol)){
+        cout << "No campaign in " << dir << endl;
+        return 1;
+    }
+    map<string, string> settings;
+    read_settings(dir, settings);
+    if(settings.count("set") && !apply_settings(rgn, settings["set"])) return 1;
+    string tag = worker_tag();
+
+    while(true){
+        vector<string> jobs;
+        for(const filesystem::directory_entry& e : filesystem::directory_iterator(dir + "queue/")){
+            jobs.push_back(e.path().filename().string());
+        }
+        if(jobs.empty()) break;
+        sort(jobs.begin(), jobs.end());
+
+        for(const string& job : jobs){
+            //rename is atomic, so exactly one worker gets each shard
+            string claimed = dir + "claimed/" + job + "@" + tag;
+            error_code ec;
+            filesystem::rename(dir + "queue/" + job, claimed, ec);
+            if(ec) continue;
+
+            if(!run_job(rgn, dir, claimed, mda_data)) return 1;
+            break;
+        }
+    }
+    return 0;
+}
+
+//puts shards claimed by a worker (or by any worker if tag is empty) back in the queue
+static void requeue_claims(const string& dir, const string& tag){
+    for(const filesystem::directory_entry& e : filesystem::directory_iterator(dir + "claimed/")){
+        string name = e.path().filename().string();
+        size_t at = name.find('@');
+        if(!tag.empty() && name.substr(at + 1) != tag) continue;
+
+        error_code ec;
+        filesystem::rename(e.path(), dir + "queue/" + name.substr(0, at), ec);
+        if(!ec) cout << "Requeued " << name.substr(0, at) << endl;
+    }
+}
+
+bool merge_shards(const string& dir, const string& out_file){
+    string mda_data;
+    int n_shards = 0;
+    double epi_tol;
+    if(!read_campaign(dir, mda_data, n_shards, epi_tol)){
+        cout << "No campaign in " << dir << endl;
+        return false;
+    }
+
+    ofstream out(out_file);
+
+    if(!out){
+        cout << "open " << out_file << " failed" << endl;
+        return false;
+    }
+    //shards are in scenario and replicate order, so this is the order of a single process run
+    for(int id = 0; id < n_shards; ++id){
+        string part = dir + "parts/" + shard_name(id) + ".csv";
+        ifstream in(part);
+        if(!in){
+            cout << "Missing " << part << endl;
+            return false;
+        }
+        string line;
+        if(getline(in, line) && id == 0) out << line << endl; //header once
+        while(getline(in, line)) out << line << endl;
+    }
+    return true;
+}
+
+int run_campaign(Region *rgn, const string& out_file, const string& mda_data, int n_workers,
+                 int shard_size, const vector<string>& hosts, const string& self_exe){
+    string dir = out_file + ".shards/";
+    vector<Shard> shards = plan_shards(mda_data, shard_size);
+
+    string old_mda;
+    int old_shards = 0;
+    if(read_campaign(dir, old_mda, old_shards, rgn->epi_tol)){ //resuming, keep the original seed and step
+        if(old_shards != (int)shards.size()){
+            cout << dir << " holds a campaign with " << old_shards << " shards, not " << shards.size() << endl;
+            return 1;
+        }
+        string old_scale = rgn->scale_dir, old_params = rgn->tran_file;
+        campaign_inputs(dir, old_scale, old_params);
+        error_code ec;
+        if(!filesystem::equivalent(old_scale, rgn->scale_dir, ec) || !filesystem::equivalent(old_params, rgn->tran_file, ec)){
+            cout << dir << " holds a campaign on " << old_scale << " with " << old_params << endl;
+            return 1;
+        }
+        requeue_claims(dir, ""); //nobody else is running
+        cout << "Resuming campaign in " << dir << endl;
+    }
+    else{
+        for(string sub : {"queue/", "claimed/", "parts/", "done/"}) filesystem::create_directories(dir + sub);
+        write_campaign(dir, mda_data, shards.size(), rgn);
+    }
+
+    int remaining = 0;
+    for(const Shard& s : shards){
+        if(filesystem::exists(dir + "done/" + shard_name(s.id))) continue;
+        ++remaining;
+        if(filesystem::exists(dir + "queue/" + shard_name(s.id))) continue;
+        ofstream(dir + "queue/" + shard_name(s.id)) << s.id << " " << s.scenario << " " << s.rep_first << " "
+                                                    << s.rep_last << " " << s.sim_offset << endl;
+    }
+    cout << remaining << " of " << shards.size() << " shards to run" << endl;
+
+    //local workers share the population the coordinator has already built
+    map<pid_t, string> workers;
+    rgn->wait_for_image(); //no threads across fork, and remote workers need the image
+    cout.flush();
+    for(int w = 0; w < n_workers && remaining > 0; ++w){
+        pid_t pid = fork();
+        if(pid == 0) _exit(run_worker(rgn, dir));
+        workers[pid] = "";
+    }
+    //remote workers need the same checkout (and the built population cache) at the same path
+    string cwd = filesystem::current_path().string();
+    string abs_dir = filesystem::absolute(dir).string();
+    for(const string& host : hosts){
+        pid_t pid = fork();
+        if(pid == 0){
+            string cmd = "cd '" + cwd + "' && '" + self_exe + "' --worker '" + abs_dir + "'";
+            execlp("ssh", "ssh", host.c_str(), cmd.c_str(), (char*)NULL);
+            _exit(127);
+        }
+        workers[pid] = host;
+    }
+
+    while(!workers.empty()){
+        int status;
+        pid_t pid = wait(&status);
+        if(pid < 0) break;
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+            cout << "Worker " << pid << (workers[pid].empty() ? "" : " on " + workers[pid]) << " failed" << endl;
+            if(workers[pid].empty()){ //local, so we know its tag
+                char host[256];
+                gethostname(host, sizeof(host));
+                requeue_claims(dir, string(host) + "@" + to_string(pid));
+            }
+        }
+        workers.erase(pid);
+    }
+
+    for(const Shard& s : shards){
+        if(!filesystem::exists(dir + "done/" + shard_name(s.id))){
+            cout << "Shard " << s.id << " did not finish, rerun to resume" << endl;
+            return 1;
+        }
+    }
+    if(!merge_shards(dir, out_file)) return 1;
+    cout << "Merged " << shards.size() << " shards into " << out_file << endl;
+    return 0;
+}
+
+//mean and variance over replicates of one output column, per (scenario, year, day) row
+struct RowStats{
+    int n = 0;
+    double sum = 0, sum_sq = 0;
+    void add(double x){ ++n; sum += x; sum_sq += x*x; }
+    double mean() const { return n > 0 ? sum/n : 0; }
+    double var() const { return n > 1 ? (sum_sq - sum*sum/n)/(n - 1) : 0; }
+};
+typedef map<tuple<int, int, int>, RowStats> ColumnStats; //(scenario, year, day)
+
+static bool read_summary(const string& file, const vector<Shard>& shards, const vector<string>& columns, vector<ColumnStats>& stats){
+    ifstream in(file);
+    string line;
+    if(!getline(in, line)){
+        cout << "No output in " << file << endl;
+        return false;
+    }
+    vector<string> header;
+    stringstream hs(line);
+    string cell;
+    while(getline(hs, cell, ',')) header.push_back(cell);
+
+    vector<string> names = {"sim_i", "year", "day"};
+    names.insert(names.end(), columns.begin(), columns.end());
+    vector<int> at;
+    for(const string& c : names){
+        at.push_back(find(header.begin(), header.end(), c) - header.begin());
+        if(at.back() == (int)header.size()){
+            cout << "No " << c << " column in " << file << endl;
+            return false;
+        }
+    }
+    int widest = *max_element(at.begin(), at.end());
+
+    stats.assign(columns.size(), ColumnStats());
+    while(getline(in, line)){
+        vector<string> row;
+        stringstream rs(line);
+        while(getline(rs, cell, ',')) row.push_back(cell);
+        if((int)row.size() <= widest) continue; //a short or torn row
+
+        int sim = atoi(row[at[0]].c_str()), scenario = 0;
+        for(const Shard& s : shards) if(s.sim_offset <= sim) scenario = s.scenario;
+        tuple<int, int, int> key(scenario, atoi(row[at[1]].c_str()), atoi(row[at[2]].c_str()));
+        for(size_t c = 0; c < columns.size(); ++c) stats[c][key].add(atof(row[at[3 + c]].c_str()));
+    }
+    return true;
+}
+
+//Runs every scenario with the fixed EPI_DT step into <out>.fixed.csv and with the adaptive
+//step into <out> from the same seeds, then compares the replicate means of each output row.
+int validate_epi_step(Region *rgn, const string& out_file, const string& mda_data){
+    double tol = rgn->epi_tol;
+    if(tol <= 0){
+        cout << "--validate-step needs an adaptive step, set one with --epi-tol" << endl;
+        return 1;
+    }
+    string files[2] = {out_file + ".fixed.csv", out_file};
+    for(const string& f : files){
+        if(filesystem::exists(f)){ //output_epidemics appends, old rows would be compared too
+            cout << f << " already exists" << endl;
+            return 1;
+        }
+    }
+
+    vector<Shard> shards = plan_shards(mda_data, numeric_limits<int>::max());
+    uint64_t steps[2];
+    double seconds[2];
+    for(int m = 0; m < 2; ++m){
+        rgn->epi_tol = m == 0 ? 0 : tol;
+        out_path = files[m];
+        uint64_t first_step = rgn->epi_steps;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        for(const Shard& shard : shards){
+            MDAStrat strategy = get_mda_strat(mda_data, shard.scenario + 1);
+            run_replicates(rgn, strategy, shard);
+        }
+        seconds[m] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        steps[m] = rgn->epi_steps - first_step;
+    }
+    out_path = out_file;
+
+    vector<string> columns {"pop_total", "inf_total", "ant_total"};
+    vector<ColumnStats> at_fixed, at_adaptive;
+    if(!read_summary(files[0], shards, columns, at_fixed) || !read_summary(files[1], shards, columns, at_adaptive)) return 1;
+
+    cout << endl << "Epi step validation, fixed " << EPI_DT << " days against --epi-tol " << tol << endl;
+    cout << "fixed: " << steps[0] << " epi steps in " << seconds[0] << " s" << endl;
+    cout << "adaptive: " << steps[1] << " epi steps in " << seconds[1] << " s" << endl;
+
+    cout << "scenario,year,column,fixed,adaptive,z" << endl;
+
+    int n_rows = 0, n_far = 0;
+    double max_z = 0;
+    for(size_t c = 0; c < columns.size(); ++c){
+        for(ColumnStats::iterator r = at_fixed[c].begin(); r != at_fixed[c].end(); ++r){
+            const RowStats& f = r->second;
+            const RowStats& a = at_adaptive[c][r->first];
+            double se = sqrt(f.var()/max(f.n, 1) + a.var()/max(a.n, 1));
+            double z = se > 0 ? (a.mean() - f.mean())/se : 0;
+            ++n_rows;
+            if(fabs(z) > 3) ++n_far;
+            max_z = max(max_z, fabs(z));
+
+            if(get<2>(r->first) == 0){ //yearly rows only
+                cout << get<0>(r->first) + 1 << "," << get<1>(r->first) << "," << columns[c] << ","
+                     << fixed << setprecision(1) << f.mean() << "," << a.mean() << "," << setprecision(2) << z << endl;
+            }
+        }
+    }
+    cout << n_far << " of " << n_rows << " rows differ by more than 3 standard errors (largest |z| " << setprecision(2) << max_z << ")" << endl;
+
+    return 0;
+}
+
+//--crn: replicate i of every scenario against replicate i of scenario 1, for each yearly row,
+//into <out>.paired.csv. se_unpaired is what independent scenarios of the same size would give,
+//so (se_unpaired/se_paired)^2 is how many times fewer replicates the pairing needs.
+int report_paired(const string& out_file, const string& mda_data){
+    vector<Shard> shards = plan_shards(mda_data, numeric_limits<int>::max());
+    ifstream in(out_file);
+    string line;
+    if(!getline(in, line)){
+        cout << "No output in " << out_file << endl;
+        return 1;
+    }
+    vector<string> header;
+    stringstream hs(line);
+    string cell;
+    while(getline(hs, cell, ',')) header.push_back(cell);
+
+    vector<int> at;
+    for(const char *c : {"sim_i", "year", "day", "inf_total", "ant_total"}){
+        at.push_back(find(header.begin(), header.end(), c) - header.begin());
+        if(at.back() == (int)header.size()){
+            cout << "No " << c << " column in " << out_file << endl;
+            return 1;
+        }
+    }
+    int widest = *max_element(at.begin(), at.end());
+
+    const vector<string> columns {"inf_total", "ant_total", "mf_free"}; //mf_free: nobody m.f. positive
+    map<tuple<int, int, int>, vector<double>> values; //(scenario, year, column), by replicate
+    while(getline(in, line)){
+        vector<string> row;
+        stringstream rs(line);
+        while(getline(rs, cell, ',')) row.push_back(cell);
+        if((int)row.size() <= widest) continue; //a short or torn row
+        if(atoi(row[at[2]].c_str()) != 0) continue; //yearly rows only
+
+        int sim = atoi(row[at[0]].c_str());
+        const Shard *shard = &shards[0];
+        for(const Shard& s : shards) if(s.sim_offset <= sim) shard = &s;
+        int rep = sim - shard->sim_offset, year = atoi(row[at[1]].c_str());
+        double inf = atof(row[at[3]].c_str());
+        double x[3] = {inf, atof(row[at[4]].c_str()), inf == 0 ? 1.0 : 0.0};
+        for(int c = 0; c < 3; ++c){
+            vector<double>& v = values[make_tuple(shard->scenario, year, c)];
+            if((int)v.size() <= rep) v.resize(rep + 1, NAN);
+            v[rep] = x[c];
+        }
+    }
+
+    string paired_file = out_file + ".paired.csv";
+    ofstream out(paired_file);
+    out << "scenario,year,column,n,diff,se_paired,se_unpaired" << endl;
+    double gain = 0;
+    int n_gain = 0;
+    for(map<tuple<int, int, int>, vector<double>>::iterator r = values.begin(); r != values.end(); ++r){
+        int scenario = get<0>(r->first);
+        if(scenario == 0) continue;
+        map<tuple<int, int, int>, vector<double>>::iterator base = values.find(make_tuple(0, get<1>(r->first), get<2>(r->first)));
+        if(base == values.end()) continue;
+
+        RowStats diff, a, b;
+        for(size_t i = 0; i < min(r->second.size(), base->second.size()); ++i){
+            if(isnan(r->second[i]) || isnan(base->second[i])) continue;
+            diff.add(r->second[i] - base->second[i]);
+            a.add(r->second[i]);
+            b.add(base->second[i]);
+        }
+        if(diff.n < 2) continue;
+        double se_paired = sqrt(diff.var()/diff.n);
+        double se_unpaired = sqrt((a.var() + b.var())/diff.n);
+        if(se_paired > 0){
+            gain += se_unpaired*se_unpaired/(se_paired*se_paired);
+            ++n_gain;
+        }
+        out << scenario + 1 << "," << get<1>(r->first) << "," << columns[get<2>(r->first)] << "," << diff.n << ","
+            << diff.mean() << "," << se_paired << "," << se_unpaired << endl;
+    }
+    cout << "Paired differences against scenario 1 in " << paired_file;
+    if(n_gain > 0) cout << ", on average they need " << setprecision(2) << gain/n_gain << " times fewer replicates than independent runs";
+    cout << endl;
+    return 0;
+}
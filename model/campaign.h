@@ -0,0 +1,60 @@
+#ifndef campaign_h
+#define campaign_h
+
+#include "network.h"
+
+// Sharded campaigns: the (scenario, replicate) grid of MDAParams.csv is split
+// into shards that worker processes (local or on other machines sharing the
+// directory) claim from <out>.shards/queue/, run and write to parts/.
+// Replicates are seeded from (base_seed, scenario, replicate) and keep the
+// sim_i they would have had in a single process run, so the merged output
+// does not depend on how the work was split.
+
+struct Shard{
+    int id;
+    int scenario;   //0-based row of MDAParams.csv
+    int rep_first;  //replicates [rep_first, rep_last)
+    int rep_last;
+    int sim_offset; //sim_i of replicate 0 of this scenario
+};
+
+double mf_prevalence(Region *rgn);  //share of the population m.f. positive
+
+//final-year elimination (nobody m.f. positive) and m.f. prevalence over a scenario's
+//replicates, with their 95% intervals (Wilson for the probability)
+struct ScenarioRun{
+    int n = 0;
+    int n_elim = 0;
+    double prev_sum = 0, prev_sum_sq = 0;
+
+    void add(Region *rgn);
+    double elim() const { return n > 0 ? n_elim/(double)n : 0; }
+    double elim_half() const;
+    double prev() const { return n > 0 ? prev_sum/n : 0; }
+    double prev_half() const;
+    bool precise() const;   //STOP_ELIM_WIDTH and STOP_PREV_WIDTH met after STOP_MIN_SIMS
+};
+
+vector<Shard> plan_shards(const string& mda_data, int shard_size);
+//may_stop: the shard is the whole scenario, so it ends once precise() (sequential stopping)
+ScenarioRun run_replicates(Region *rgn, MDAStrat& strategy, const Shard& shard, bool may_stop = false);
+
+int run_campaign(Region *rgn, const string& out_file, const string& mda_data, int n_workers,
+                 int shard_size, const vector<string>& hosts, const string& self_exe);
+int run_worker(Region *rgn, const string& dir);
+bool campaign_inputs(const string& dir, string& scale_dir, string& tran_file); //scale and parameters a campaign runs on
+
+bool merge_shards(const string& dir, const string& out_file);
+
+int validate_epi_step(Region *rgn, const string& out_file, const string& mda_data); //--validate-step
+int report_paired(const string& out_file, const string& mda_data);                  //--crn
+int run_splitting(Region *rgn, const string& out_file, const string& mda_data,   //--split (splitting.cpp)
+                  const vector<double>& levels, int factor);
+int run_mlmc(Region *rgn, const string& out_file, const string& mda_data, double eps);  //--mlmc (mlmc.cpp)
+
+bool apply_settings(Region *rgn, const string& settings);   //NAME=VALUE,... (--set, sweep.cpp)
+int run_sweep(Region *rgn, const string& out_file, const string& mda_data, const string& spec_file,  //--sweep
+              const string& design, int n_points, int n_workers, const vector<int>& years);
+
+
+#endif /* campaign_h */
@@ -1,2 +1,3 @@
-rm ../\$config/ABC.init
-rm ../\$config/pop/*
+# population images and distance caches are keyed by their inputs, so they never go stale,
+# this clears them to save space or force a rebuild
+rm -f ../\$config/*.pop ../\$config/dist-*.bin ../\$config/commute-*.bin ../\$config/near-*.bin ../\$config/demog-*.bin
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "network.h"
+#include "store.h"
+#include "table.h"
+
+using namespace std;
+
+// Demography replay (DEMOG_REPLAYS). Deaths, births and who commutes where never depend on
+// infection, so DEMOG_REPLAYS trajectories of them are simulated once per scale, each on its
+// own stream, and replicate i replays trajectory i % DEMOG_REPLAYS: the same people die (by
+// aid), the same groups have babies (aids follow next_aid as they would) and everyone keeps
+// the same day group, with only the infection drawn live. Replicate i of every parameter set
+// then has the same demography (common random numbers). Babies' bite scales depend on
+// agg_param, so are still drawn live.
+//
+// <config>/demog-<key>.bin:
+//
+//   DemogHeader
+//   per trajectory: int64 sizes[7], then the arrays of Region::Demography in that order
+
+static_assert(!(HYBRID_POP && DEMOG_REPLAYS > 0), "pools have a demography of their own, use HYBRID_POP or DEMOG_REPLAYS");
+
+constexpr char DEMOG_MAGIC[8] = "NETFDEM";
+constexpr uint32_t DEMOG_VERSION = 1;
+constexpr int DEMOG_ARRAYS = 7;
+
+struct DemogHeader{
+    char magic[8];
+    uint32_t version;
+    int32_t replays;
+    uint64_t key;
+};
+
+static vector<int32_t>* demog_arrays(Region::Demography& d, int i){
+    vector<int32_t>* arrays[DEMOG_ARRAYS] = {&d.death_start, &d.deaths, &d.birth_start, &d.births,
+                                             &d.commute_years, &d.commute_start, &d.commute};
+    return arrays[i];
+}
+
+//the population image, rates, commuting inputs and the constants that shape a trajectory
+uint64_t Region::demog_key(){
+    uint64_t key = hash_files({scale_dir + CAR_DISTANCE, scale_dir + CROW_DISTANCE,
+                               data_dir + BIRTH_FILE, data_dir + MORTALITY_FILE}, pop_key());
+    int32_t shape[4] = {SIM_YEARS, DEMOG_REPLAYS, RECALC_YEARS, COMMUTE_K};
+    double commute[2] = {COMMUTING_PROP, COMMUTE_CUTOFF};
+    key = hash_bytes(shape, sizeof(shape), key);
+    key = hash_bytes(commute, sizeof(commute), key);
+    return hash_bytes(&DISTANCE_TYPE, 1, key);
+}
+
+void Region::load_demography(){
+    uint64_t key = demog_key();
+    string file = store_path(config_dir, "demog", key);
+
+    MappedFile in(file);
+    const DemogHeader *head = (const DemogHeader*)in.data();
+    if(in.ok() && in.size() >= sizeof(DemogHeader) && memcmp(head->magic, DEMOG_MAGIC, sizeof(head->magic)) == 0
+       && head->version == DEMOG_VERSION && head->key == key && head->replays == DEMOG_REPLAYS){
+        demography.assign(DEMOG_REPLAYS, Demography());
+        size_t at = sizeof(DemogHeader);
+        bool whole = true;
+        for(int r = 0; r < DEMOG_REPLAYS && whole; ++r){
+            int64_t sizes[DEMOG_ARRAYS];
+            whole = at + sizeof(sizes) <= in.size();
+            if(whole) memcpy(sizes, in.data() + at, sizeof(sizes));
+            at += sizeof(sizes);
+            for(int a = 0; a < DEMOG_ARRAYS && whole; ++a){
+                whole = sizes[a] >= 0 && at + sizes[a]*sizeof(int32_t) <= in.size();
+                if(!whole) break;
+                const int32_t *data = (const int32_t*)(in.data() + at);
+                demog_arrays(demography[r], a)->assign(data, data + sizes[a]);
+                at += sizes[a]*sizeof(int32_t);
+            }
+        }
+        if(whole && at == in.size()) return;
+        cout << file << " is truncated, simulating the demography again" << endl;
+    }
+
+    //each trajectory from the built population on its own stream, so replicates' draws are untouched
+    demography.assign(DEMOG_REPLAYS, Demography());
+    RngStream *stream = cur_stream;
+    RngStream own;
+    replay = nullptr;
+    for(int r = 0; r < DEMOG_REPLAYS; ++r){
+        seed_stream(own, key, r);
+        cur_stream = &own;
+        recording = &demography[r];
+        if(!pop_reload(false)){
+            cout << "reload pop err" << endl;
+            exit(1);
+        }
+        for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){ //as seed_lf does
+            for(map<int, Agent*>::iterator k = j->second->group_pop.begin(); k != j->second->group_pop.end(); ++k){
+                k->second->ngp = j->second;
+            }
+        }
+        for(int year = 0; year < SIM_YEARS; ++year){
+            handle_commute(year);
+            for(int day = 0; day < 364; day += 28){
+                renew_pop(28);
+                handle_birth(28);
+            }
+        }
+        recording = nullptr;
+        cur_stream = stream;
+        clear_population();
+    }
+
+    DemogHeader head_out;
+    memcpy(head_out.magic, DEMOG_MAGIC, sizeof(head_out.magic));
+    head_out.version = DEMOG_VERSION;
+    head_out.replays = DEMOG_REPLAYS;
+    head_out.key = key;
+    vector<int64_t> sizes;
+    for(int r = 0; r < DEMOG_REPLAYS; ++r){
+        for(int a = 0; a < DEMOG_ARRAYS; ++a) sizes.push_back(demog_arrays(demography[r], a)->size());
+    }
+    vector<pair<const void*, size_t>> blocks {{&head_out, sizeof(head_out)}};
+    for(int r = 0; r < DEMOG_REPLAYS; ++r){
+        blocks.push_back({&sizes[r*DEMOG_ARRAYS], DEMOG_ARRAYS*sizeof(int64_t)});
+        for(int a = 0; a < DEMOG_ARRAYS; ++a){
+            vector<int32_t>* v = demog_arrays(demography[r], a);
+            blocks.push_back({v->data(), v->size()*sizeof(int32_t)});
+        }
+    }
+    store_write(file, blocks);
+}
+
+void Region::replay_deaths(int dt){
+    ScopedPhase timer(PHASE_RENEW_POP);
+    const vector<int32_t>& deaths = replay->deaths;
+    for(int d = replay->death_start[demog_step]; d < replay->death_start[demog_step + 1]; ++d){
+        Group *grp = groups.find(deaths[2*d])->second;
+        remove_agent(grp->group_pop.find(deaths[2*d + 1])->second);
+    }
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        profile_visit(PHASE_RENEW_POP, j->second->group_pop.size());
+        for(map<int, Agent*>::iterator k = j->second->group_pop.begin(); k != j->second->group_pop.end(); ++k){
+            k->second->age += dt;
+        }
+    }
+    age_clock += dt;
+    ++lane_epoch;
+}
+
+void Region::replay_births(){
+    ScopedPhase timer(PHASE_HANDLE_BIRTH);
+    for(int b = replay->birth_start[demog_step]; b < replay->birth_start[demog_step + 1]; ++b){
+        Group *grp = groups.find(replay->births[b])->second;
+        Agent *bby = new Agent(next_aid++, agg_param, 0);
+        bby->ngp = grp;
+        bby->dgp = grp;
+        grp->add_member(bby);
+        grp->day_population.insert(pair<int, Agent*>(bby->aid, bby));
+    }
+    ++demog_step; //births end a population step
+    ++lane_epoch;
+}
+
+void Region::replay_commute(int year){
+    size_t c = find(replay->commute_years.begin(), replay->commute_years.end(), year) - replay->commute_years.begin();
+    int at = replay->commute_start[c];
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j) j->second->day_population.clear();
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        for(map<int, Agent*>::iterator k = j->second->group_pop.begin(); k != j->second->group_pop.end(); ++k){
+            Agent *agt = k->second;
+            agt->dgp = groups.find(replay->commute[at++])->second;
+            agt->dgp->day_population.insert(pair<int, Agent*>(agt->aid, agt));
+        }
+    }
+}
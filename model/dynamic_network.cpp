@@ -4,15 +4,21 @@
 #include <algorithm>
 
 void Region::implement_mda(int year, MDAStrat strat){
+    if(!parts.empty()){
+        part_mda(year, strat);
+        return;
+    }
+    ScopedPhase timer(PHASE_MDA);
     int n_pop = 0;
     int n_treated = 0;
     int n_under_min = 0;
+    vector<int> pool_eligible; //per group, the same count when treating
 
     for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){ //for every group
         
         Group *grp = j->second;
         
-        n_pop += grp->group_pop.size();
+        n_pop += grp->population();
         
         for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){ //for every person 
             
@@ -21,11 +27,15 @@ void Region::implement_mda(int year, MDAStrat strat){
             if (age<strat.min_age) ++n_under_min; 
 
         }
+        int pool_under = pooled_under(grp, strat.min_age);
+        n_under_min += pool_under;
+        pool_eligible.push_back(grp->pooled - pool_under);
     }
 
     double target_prop = 1 - n_under_min /(double)n_pop;
 
-    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){ //for every group
+    size_t g = 0;
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j, ++g){ //for every group
         
         Group *grp = j->second;
         
@@ -39,24 +49,32 @@ void Region::implement_mda(int year, MDAStrat strat){
                 }
             }
         }
+        //pooled people have no worms, so only the count matters
+        if(pool_eligible[g] > 0) n_treated += binomial(pool_eligible[g], min(1.0, strat.coverage/target_prop));
     }
 
+    profile_visit(PHASE_MDA, 2*n_pop);
     number_treated[year] = n_treated;
     achieved_coverage[year] = n_treated/(double)n_pop;
 }
 
 void Region::handle_commute(int year){
-    
+    ScopedPhase timer(PHASE_HANDLE_COMMUTE);
+
     //firstly need to clear previous storage
    
     if (year % RECALC_YEARS == 0){    
         
-        if (groups.size() > 1){
+        if (groups.size() > 1 && replay) replay_commute(year);
+        else if (groups.size() > 1){
+            expand_pools(); //pooled people need new day groups too
+
             radt_model(DISTANCE_TYPE); //generating commuting network
             for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){ //now using the network
                 Group *grp = j->second;
                 int no_commute_id = grp->gid;
                 double commuter_prop = grp->total_commute / (double) grp->group_pop.size();
+                profile_visit(PHASE_HANDLE_COMMUTE, grp->group_pop.size());
                 //now iterating over all group members
                 for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
                     Agent *agt = k->second; //our agent
@@ -86,20 +104,36 @@ void Region::handle_commute(int year){
                     found_commute:;
                 }
             }
+            if(recording){
+                recording->commute_years.push_back(year);
+                for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+                    for(map<int, Agent*>::iterator k = j->second->group_pop.begin(); k != j->second->group_pop.end(); ++k){
+                        recording->commute.push_back(k->second->dgp->gid);
+                    }
+                }
+                recording->commute_start.push_back(recording->commute.size());
+            }
         }
         //we will also update all agents biting probs 
 
     }
     
+    ++lane_epoch; //new day populations
     rpop = 0;
     for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
         Group *grp = j->second;   
-        rpop += grp->group_pop.size();
+        rpop += grp->population();
     }
+
 }
 
-void Region::calc_risk(){
-    
+void Region::calc_risk(double steps){
+    if(!parts.empty()){
+        part_calc_risk(steps);
+        return;
+    }
+    ScopedPhase timer(PHASE_CALC_RISK);
+
     char form = 'l'; //l for limitation, f for facilation, or anything else for linear 
     bool single = false;
 
@@ -107,50 +141,63 @@ void Region::calc_risk(){
         single = true;
     }
 
-    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){ //setting the force of transmission in each group to 0
+    //only groups with an infected agent in them have non-zero force of infection,
+    //so last week's active groups are the only ones that need resetting
+    for(map<int, Group*>::iterator j = night_active.begin(); j != night_active.end(); ++j){
+        j->second->night_strength = 0;
+    }
+    for(map<int, Group*>::iterator j = day_active.begin(); j != day_active.end(); ++j){
+        j->second->day_strength = 0;
+    }
+    night_active.clear();
+    day_active.clear();
+
+    profile_visit(PHASE_CALC_RISK, inf_indiv.size());
+    for(map<int, Agent*>::iterator j = inf_indiv.begin(); j != inf_indiv.end(); ++j){
+        Agent *agt = j->second;
+        night_active.insert(pair<int, Group*>(agt->ngp->gid, agt->ngp));
+        if(!single) day_active.insert(pair<int, Group*>(agt->dgp->gid, agt->dgp));
+    }
+
+    //bite denominators of the active groups
+    for(map<int, Group*>::iterator j = night_active.begin(); j != night_active.end(); ++j){
         Group *grp = j->second;
-        
-        grp->day_strength = 0;
-        grp->night_strength = 0;
-        grp->night_bites = 0;
-        grp->day_bites = 0;
-        double db = 0;
-        double nb = 0;
-
-        for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
-            Agent *agt =k->second;
-            int age = int(agt->age / 365);
-            double c = 1.0;
-            if(age <= 15) c = exposure_by_age[age];
-            nb += agt->bite_scale*c;    
+        double nb = lane_bite_sum(lanes(grp->night_lanes, grp->group_pop));
+        for(map<tuple<int, int, int>, Group::Pool>::iterator k = grp->pools.begin(); k != grp->pools.end(); ++k){
+            Group::Pool& pool = k->second;
+            nb += pool.count*bite_means[pool.bin]*age_exposure(pool_age(pool));
         }
-        if(!single){
-            for(map<int, Agent*>::iterator k = grp->day_population.begin(); k != grp->day_population.end(); ++k){
-                Agent *agt =k->second;
-                int age = int(agt->age / 365);
-                double c = 1.0;
-                if(age <= 15) c = exposure_by_age[age];
-                db += agt->bite_scale*c;    
+        grp->night_bites = nb;
+        profile_visit(PHASE_CALC_RISK, grp->group_pop.size());
+    }
+    for(map<int, Group*>::iterator j = day_active.begin(); j != day_active.end(); ++j){
+        Group *grp = j->second;
+        grp->day_bites = lane_bite_sum(lanes(grp->day_lanes, grp->day_population));
+        profile_visit(PHASE_CALC_RISK, grp->day_population.size());
+    }
+    if(HYBRID_POP){ //pooled commuters are kept by their night group
+        for(map<int, Group*>::iterator j = day_active.begin(); j != day_active.end(); ++j){
+            Group *dgrp = j->second;
+            for(map<int, Group*>::iterator h = dgrp->pool_homes.begin(); h != dgrp->pool_homes.end(); ++h){
+                Group *home = h->second;
+                for(map<tuple<int, int, int>, Group::Pool>::iterator k = home->day_pools(dgrp->gid); k != home->pools.end() && get<0>(k->first) == dgrp->gid; ++k){
+                    Group::Pool& pool = k->second;
+                    dgrp->day_bites += pool.count*bite_means[pool.bin]*age_exposure(pool_age(pool));
+                }
             }
-            grp->day_bites = db;
-        }else{
-            grp->day_bites = 0;
         }
-        grp->night_bites = nb;
-       
     }
+
     //Finding strength of infection in each group
     //now looping over all infected agents
+    expected_bites = 0;
     for(map<int, Agent*>::iterator j = inf_indiv.begin(); j != inf_indiv.end(); ++j){
         
         Agent *agt =j->second;
         Group *ngrp = agt->ngp; //infected agents nightime group
 
-        int age = int(agt->age / 365);
-        double c = 1.0;
-
-        if(age <= 15) c = exposure_by_age[age];
-        
+        double c = age_exposure(agt->age);
+        expected_bites += c*agt->bite_scale*mf_functional_form(form, j->second->worm_strength); //summed over groups the denominators cancel
         ngrp->night_strength += (c*agt->bite_scale*mf_functional_form(form, j->second->worm_strength)) / ngrp->night_bites;
         
         if(!single){
@@ -158,28 +205,108 @@ void Region::calc_risk(){
             dgrp->day_strength += (c*agt->bite_scale*mf_functional_form(form, j->second->worm_strength)) / dgrp->day_bites;
         }
     }
+    if(steps != 1){ //strengths are per EPI_DT
+        for(map<int, Group*>::iterator j = night_active.begin(); j != night_active.end(); ++j) j->second->night_strength *= steps;
+        for(map<int, Group*>::iterator j = day_active.begin(); j != day_active.end(); ++j) j->second->day_strength *= steps;
+    }
 
-    //Now finding infective bites
-    
-    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){ //looping over groups
+    //Now finding infective bites, night bites for residents of active groups
+    //and day bites for everyone in an active group during the day
+    double night_share = single ? 1.0 : 1.0 - worktonot;
+    double max_exposure = 1.0; //bounds everyone's chance of a bite for the pools
+    for(int age = 0; age <= 15; ++age) max_exposure = max(max_exposure, exposure_by_age[age]);
+    for(map<int, Group*>::iterator j = night_active.begin(); j != night_active.end(); ++j){
         Group *grp = j->second;
-        //looping over all people!
-        
-        for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){ //looping over all people will do both night and day bites in same loop
-        
-            Agent *agt = k->second; //our person
-            char prev_status = agt ->status;
-            double c = 1; //
-            int age = int(agt->age / 365);
-            if (age <= 15) c = exposure_by_age[age];
-            
-            agt->sim_bites(c, worktonot, single); // simulating the bites!
-
-            if(agt->status == 'E' && prev_status == 'S'){
-                pre_indiv.insert(pair<int, Agent*>(agt->aid, agt));
+        profile_visit(PHASE_CALC_RISK, grp->group_pop.size());
+        lane_bites(lanes(grp->night_lanes, grp->group_pop), grp->night_strength, night_share, pre_indiv);
+        //pooled people who are bitten become agents
+        if(!grp->pools.empty()){
+            vector<double> p_max;
+            vector<EventSkipper> bites;
+            for(int b = 0; b < POOL_BITE_BINS; ++b){ //bite scales are very skewed, so bound each bin separately
+                p_max.push_back(-expm1(-max_exposure * grp->night_strength * bite_edges[b] * night_share));
+                bites.push_back(EventSkipper(p_max[b]));
+            }
+            for(map<tuple<int, int, int>, Group::Pool>::iterator k = grp->pools.begin(); k != grp->pools.end(); ++k){
+                Group::Pool& pool = k->second;
+                pool_bites(pool, grp, grp->night_strength * night_share, p_max[pool.bin], bites[pool.bin]);
             }
         }
     }
+    for(map<int, Group*>::iterator j = day_active.begin(); j != day_active.end(); ++j){
+        Group *grp = j->second;
+        profile_visit(PHASE_CALC_RISK, grp->day_population.size());
+        lane_bites(lanes(grp->day_lanes, grp->day_population), grp->day_strength, worktonot, pre_indiv);
+    }
+    if(HYBRID_POP && !bite_edges.empty()){
+        for(map<int, Group*>::iterator j = day_active.begin(); j != day_active.end(); ++j){
+            Group *dgrp = j->second;
+            if(dgrp->pool_homes.empty()) continue;
+            vector<double> p_max; //per bin, as for night bites
+            vector<EventSkipper> bites;
+            for(int b = 0; b < POOL_BITE_BINS; ++b){
+                p_max.push_back(-expm1(-max_exposure * dgrp->day_strength * bite_edges[b] * worktonot));
+                bites.push_back(EventSkipper(p_max[b]));
+            }
+            for(map<int, Group*>::iterator h = dgrp->pool_homes.begin(); h != dgrp->pool_homes.end(); ++h){
+                Group *home = h->second;
+                for(map<tuple<int, int, int>, Group::Pool>::iterator k = home->day_pools(dgrp->gid); k != home->pools.end() && get<0>(k->first) == dgrp->gid; ++k){
+                    Group::Pool& pool = k->second;
+                    pool_bites(pool, home, dgrp->day_strength * worktonot, p_max[pool.bin], bites[pool.bin]);
+                }
+            }
+        }
+    }
+}
+
+double Region::age_exposure(int age){
+    int years = int(age / 365);
+    if(years <= 15) return exposure_by_age[years];
+
+    return 1.0;
+}
+
+Group::Lanes& Region::lanes(Group::Lanes& l, map<int, Agent*>& people){
+    if(l.epoch == lane_epoch) return l;
+
+    l.agt.clear();
+    l.exposure.clear();
+    l.scale.clear();
+    for(map<int, Agent*>::iterator k = people.begin(); k != people.end(); ++k){
+        l.agt.push_back(k->second);
+        l.exposure.push_back(age_exposure(k->second->age));
+        l.scale.push_back(k->second->bite_scale);
+    }
+    l.rate.resize(l.agt.size());
+    l.epoch = lane_epoch;
+    return l;
+}
+
+double Region::lane_bite_sum(Group::Lanes& l){
+    double sum = 0;
+    for(size_t i = 0; i < l.agt.size(); ++i) sum += l.scale[i]*l.exposure[i];
+    return sum;
+}
+
+//the rates vectorise, and almost everyone draws no bites (poisson settles that from one
+//uniform), so only people who are bitten are visited
+void Region::lane_bites(Group::Lanes& l, double strength, double share, map<int, Agent*>& pre){
+    size_t n = l.agt.size();
+    const double *e = l.exposure.data(), *b = l.scale.data();
+    double *r = l.rate.data();
+    for(size_t i = 0; i < n; ++i) r[i] = e[i] * strength * b[i] * share;
+
+    for(size_t i = 0; i < n; ++i){
+        int bites = poisson(r[i]);
+        if(bites == 0) continue;
+
+        Agent *agt = l.agt[i];
+        char prev_status = agt->status;
+        agt->add_worms(bites);
+        if(agt->status == 'E' && prev_status == 'S'){
+            pre.insert(pair<int, Agent*>(agt->aid, agt));
+        }
+    }
 }
 
 double Region::mf_functional_form(char form, double worm_strength){
@@ -197,6 +324,21 @@ double Region::mf_functional_form(char form, double worm_strength){
 }
 
 void Region::update_epi_status(int year, int day, int dt){
+    ++epi_steps;
+    if(!parts.empty()){
+        part_update_epi(year, day, dt);
+        return;
+    }
+    ScopedPhase timer(PHASE_UPDATE_EPI);
+    profile_visit(PHASE_UPDATE_EPI, pre_indiv.size() + uninf_indiv.size() + inf_indiv.size());
+    epi_changes = update_status_sets(pre_indiv, uninf_indiv, inf_indiv, year, day, dt); //for the step control in epi_step
+    last_epi_dt = dt;
+}
+
+//moves agents between the sets as their status changes
+int Region::update_status_sets(map<int, Agent*>& pre_indiv, map<int, Agent*>& uninf_indiv, map<int, Agent*>& inf_indiv,
+                               int year, int day, int dt){
+    int changes = 0;
 
     for(map<int, Agent*>::iterator j = pre_indiv.begin(); j != pre_indiv.end();){ //looking at all agents with immature worms but not a set!
 
@@ -206,6 +348,7 @@ void Region::update_epi_status(int year, int day, int dt){
         if(agt->status != 'E'){ //agent has left this stage of infection
 
             agt->changed_epi_today = true;
+            ++changes;
             
             pre_indiv.erase(j++);
 
@@ -229,6 +372,7 @@ void Region::update_epi_status(int year, int day, int dt){
         else agt->changed_epi_today = false;
 
         if(agt->status != 'U'){
+            ++changes;
             uninf_indiv.erase(j++);
             if(agt->status == 'I'){
                 agt->changed_epi_today = true;
@@ -246,7 +390,9 @@ void Region::update_epi_status(int year, int day, int dt){
         if(!agt->changed_epi_today) agt->update(year, day,dt);
         else agt->changed_epi_today = false;
         if(agt->status != 'I'){
+            ++changes;
             inf_indiv.erase(j++);
+
             if(agt->status == 'E'){
                 pre_indiv.insert(pair<int, Agent*>(agt->aid, agt));
             }
@@ -256,26 +402,62 @@ void Region::update_epi_status(int year, int day, int dt){
         }
         else ++j;
     }
-
+    return changes;
 }
 
-void Region::renew_pop(int year, int day, int dt){
+void Region::renew_pop(int dt){
+    if(replay){
+        replay_deaths(dt);
+        return;
+    }
+    if(!parts.empty()){
+        part_renew_pop(dt);
+        return;
+    }
+    ScopedPhase timer(PHASE_RENEW_POP);
     //handleing deaths!
     vector<Agent*> deaths;
 
+    double p_death[N_AGE_GROUPS]; //once per age group rather than per person
+    for(int i = 0; i < N_AGE_GROUPS; ++i) p_death[i] = 1 - exp(-mortality_rate[i]*dt);
+    double p_death_max = 1 - exp(-*max_element(mortality_rate, mortality_rate + N_AGE_GROUPS)*dt);
+    EventSkipper pool_deaths(p_death_max); //pooled people are only visited when they might die
+
     for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){ //going through groups
         Group *grp = j->second;
+        profile_visit(PHASE_RENEW_POP, grp->group_pop.size());
 
         for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){ //going through group members
             Agent *agt = k->second;
             int index = int(int(agt->age/365)/5);
             if(index > 15) index = 15; //all 75+ the same
 
-            double prob = 1 - exp(-mortality_rate[index]*dt);
-            if(random_real() < prob) deaths.push_back(agt); //seeing if agent dies depending on age
+            if(random_real() < p_death[index]) deaths.push_back(agt); //seeing if agent dies depending on age
             else agt->age += dt; //increase everyones age
         }
+
+        for(map<tuple<int, int, int>, Group::Pool>::iterator k = grp->pools.begin(); k != grp->pools.end();){
+            Group::Pool& pool = k->second;
+            int candidates = pool_deaths.events(pool.count);
+            for(int c = 0; c < candidates; ++c){
+                int index = min(15, int(int((age_clock - pool_birth(pool))/365)/5));
+                if(random_real() * p_death_max < 1 - exp(-mortality_rate[index]*dt)) unpool(grp, pool);
+            }
+            if(pool.count == 0) grp->pools.erase(k++);
+            else ++k;
+        }
     }
+    age_clock += dt; //pools age by their birth bracket falling behind the clock
+    ++lane_epoch;
+
+    if(recording){
+        for(size_t d = 0; d < deaths.size(); ++d){
+            recording->deaths.push_back(deaths[d]->ngp->gid);
+            recording->deaths.push_back(deaths[d]->aid);
+        }
+        recording->death_start.push_back(recording->deaths.size()/2);
+    }
+
     while(deaths.size() > 0){ //now removing agents that have died
         Agent *agt = deaths.back();
         remove_agent(agt);
@@ -286,8 +468,13 @@ void Region::renew_pop(int year, int day, int dt){
 void Region::remove_agent(Agent *agt){
 
     //removing agent from lists of infected
-   
-    if(agt->status == 'E') pre_indiv.erase(agt->aid);
+    if(!parts.empty()){
+        Partition& p = parts[agt->ngp->part];
+        if(agt->status == 'E') p.pre_indiv.erase(agt->aid);
+        else if(agt->status == 'I') p.inf_indiv.erase(agt->aid);
+        else if(agt->status == 'U') p.uninf_indiv.erase(agt->aid);
+    }
+    else if(agt->status == 'E') pre_indiv.erase(agt->aid);
     else if(agt->status == 'I') inf_indiv.erase(agt->aid);
     else if(agt->status == 'U') uninf_indiv.erase(agt->aid);
     
@@ -306,25 +493,55 @@ void Region::remove_agent(Agent *agt){
     delete agt;
 }
 
-void Region::handle_birth(int year, int day, int dt){ //deal with births
-    
+void Region::handle_birth(int dt){ //deal with births
+    if(replay){
+        replay_births();
+        return;
+    }
+    if(!parts.empty()){
+        part_handle_birth(dt);
+        return;
+    }
+    ScopedPhase timer(PHASE_HANDLE_BIRTH);
+
     int total_births  = 0;
+    ++lane_epoch; //babies join group_pop and day_population
+
+    double p_birth[N_AGE_GROUPS];
+    for(int i = 0; i < N_AGE_GROUPS; ++i) p_birth[i] = 1 - exp(-birth_rate[i]*dt);
+    double p_birth_max = 1 - exp(-*max_element(birth_rate, birth_rate + N_AGE_GROUPS)*dt);
+    EventSkipper pool_mothers(p_birth_max);
 
     for(map<int,Group*>::iterator j = groups.begin(); j != groups.end(); j++){//looping over groups
         Group *grp = j->second;
+        profile_visit(PHASE_HANDLE_BIRTH, grp->group_pop.size());
         for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){//over agents
            
             Agent *agt = k->second;
             if(agt->age >= 15*365 && agt->age < 50*365){
                 int index = int((int(agt->age/365))/5);
-                double prob = 1 - exp(-birth_rate[index]*dt);
                 
-                if(random_real() < prob) ++total_births; 
+                if(random_real() < p_birth[index]) ++total_births; 
             }
             
         }
+        for(map<tuple<int, int, int>, Group::Pool>::iterator k = grp->pools.begin(); k != grp->pools.end(); ++k){
+            Group::Pool& pool = k->second;
+            int candidates = pool_mothers.events(pool.count);
+            for(int c = 0; c < candidates; ++c){
+                int age = age_clock - pool_birth(pool);
+                if(age >= 15*365 && age < 50*365 && random_real() * p_birth_max < 1 - exp(-birth_rate[int(int(age/365)/5)]*dt)) ++total_births;
+            }
+        }
+        //babies have no worms, so in hybrid mode they start in a pool
+        if(HYBRID_POP && !bite_edges.empty()){
+            for(; total_births > 0; --total_births){
+                pool_person(grp, grp, bite_gamma(agg_param, 1/agg_param), 0);
+            }
+        }
         //now assigning births
         while (total_births > 0) {
+            if(recording) recording->births.push_back(grp->gid);
             Agent *bby = new Agent(next_aid++, agg_param, 0); //have birth!
             bby->ngp = grp;
             bby->dgp = grp;
@@ -334,4 +551,5 @@ void Region::handle_birth(int year, int day, int dt){ //deal with births
             --total_births;
         }
     }
+    if(recording) recording->birth_start.push_back(recording->births.size());
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "network.h"
+#include <math.h>
+
+//Once no one has worms the infection can never come back, so the rest of the replicate
+//only needs the population (for the pop_ columns, treatment counts and births) and
+//who is still antigen positive. Agents are replaced by counts per group and age,
+//except people with recent adult worms who are kept as AntRecords until their antigen
+//has (almost surely) gone.
+
+int Group::population(){
+    if(rgn->eliminated) return cohort_total;
+    return group_pop.size() + pooled;
+}
+
+void Region::start_fast_forward(int year, int day){
+    int population_dt = 28; //cohort width, same as the population step in Region::sim
+    double now = year*365 + day;
+
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        Group *grp = j->second;
+        grp->cohort.clear();
+        grp->cohort_total = grp->group_pop.size() + grp->pooled;
+
+        for(map<tuple<int, int, int>, Group::Pool>::iterator k = grp->pools.begin(); k != grp->pools.end(); ++k){
+            for(int i = 0; i < k->second.count; ++i){
+                int b = (age_clock - pool_birth(k->second)) / population_dt;
+                if(b >= (int)grp->cohort.size()) grp->cohort.resize(b + 1, 0);
+                ++grp->cohort[b];
+            }
+        }
+        grp->pools.clear();
+        grp->pool_homes.clear();
+        grp->pooled = 0;
+
+        for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
+            Agent *agt = k->second;
+            if(pow(DAILY_PROB_LOSE_ANT, now - agt->last_mworm_time) > ELIM_ANT_CUTOFF){
+                lingering.push_back(AntRecord {grp, agt->age, agt->last_mworm_time});
+            }
+            else{
+                int b = agt->age / population_dt; //ages are rounded down to a step
+                if(b >= (int)grp->cohort.size()) grp->cohort.resize(b + 1, 0);
+                ++grp->cohort[b];
+            }
+            delete agt;
+        }
+        grp->group_pop.clear();
+        grp->day_population.clear();
+    }
+    rpop = 0;
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        rpop += j->second->cohort_total;
+    }
+    pre_indiv.clear();
+    inf_indiv.clear();
+    uninf_indiv.clear();
+    no_worms_indiv.clear();
+    parts.clear();
+    night_active.clear();
+    day_active.clear();
+
+    eliminated = true;
+}
+
+void Region::fast_forward(int year, int first_day, MDAStrat strat){
+    ScopedPhase timer(PHASE_FAST_FORWARD);
+
+    int population_dt = 28;
+
+    for(int day = first_day; day < 364; ++day){
+        if((day % population_dt == 0) && (ELIM_FAST_FORWARD == 'c')){
+            PurposeStream use(STREAM_DEMOGRAPHY);
+            cohort_demography(year, day, population_dt);
+        }
+
+        if((strat.is_mda_year(year+START_YEAR)) && (day == 28)){
+            PurposeStream use(STREAM_MDA);
+            cohort_mda(year, strat);
+        }
+
+        if ((day % 91 == 0) && (!ABC_FITTING) && (day != 364)){
+            output_epidemics(year, day, strat);
+        }
+    }
+}
+
+void Region::cohort_demography(int year, int day, int dt){
+    //deaths then ageing, as in renew_pop
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        Group *grp = j->second;
+        vector<int>& cohort = grp->cohort;
+        profile_visit(PHASE_FAST_FORWARD, cohort.size());
+
+        for(int b0 = 0; b0 < (int)cohort.size();){ //one mortality band at a time
+            int index = int(int(b0*dt/365)/5);
+            if(index > 15) index = 15; //all 75+ the same
+            int b1 = index == 15 ? cohort.size() : min((int)cohort.size(), ((index+1)*5*365 + dt - 1) / dt);
+
+            EventSkipper deaths(1 - exp(-mortality_rate[index]*dt));
+            for(int b = b0; b < b1; ++b){
+                int died = deaths.events(cohort[b]);
+                cohort[b] -= died;
+                grp->cohort_total -= died;
+            }
+            b0 = b1;
+        }
+        cohort.insert(cohort.begin(), 0);
+        while(cohort.size() > 1 && cohort.back() == 0) cohort.pop_back();
+    }
+    for(size_t i = 0; i < lingering.size();){
+        AntRecord& rec = lingering[i];
+        int index = int(int(rec.age/365)/5);
+        if(index > 15) index = 15;
+
+        if(random_real() < 1 - exp(-mortality_rate[index]*dt)){
+            --rec.grp->cohort_total;
+            lingering[i] = lingering.back();
+            lingering.pop_back();
+        }
+        else if(pow(DAILY_PROB_LOSE_ANT, year*365 + day - rec.last_mworm_time) <= ELIM_ANT_CUTOFF){ //antigen gone, just count them
+            int b = (rec.age + dt) / dt;
+            if(b >= (int)rec.grp->cohort.size()) rec.grp->cohort.resize(b + 1, 0);
+            ++rec.grp->cohort[b];
+
+            lingering[i] = lingering.back();
+            lingering.pop_back();
+        }
+        else{
+            rec.age += dt;
+            ++i;
+        }
+    }
+
+    //then births, as in handle_birth (newborns go in the empty first cohort)
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        Group *grp = j->second;
+        vector<int>& cohort = grp->cohort;
+        int births = 0;
+        for(int b0 = 0; b0 < (int)cohort.size();){ //one birth rate band at a time
+            int index = int(int(b0*dt/365)/5);
+            int b1 = min((int)cohort.size(), ((index+1)*5*365 + dt - 1) / dt); //first cohort of the next band
+
+            if(b0*dt >= 15*365 && b0*dt < 50*365){
+                EventSkipper mothers(1 - exp(-birth_rate[index]*dt));
+                for(int b = b0; b < b1; ++b) births += mothers.events(cohort[b]);
+            }
+            b0 = b1;
+        }
+        grp->cohort[0] += births;
+        grp->cohort_total += births;
+    }
+    for(size_t i = 0; i < lingering.size(); ++i){
+        AntRecord& rec = lingering[i];
+        if(rec.age >= 15*365 && rec.age < 50*365){
+            int index = int(int(rec.age/365)/5);
+            if(random_real() < 1 - exp(-birth_rate[index]*dt)){
+                ++rec.grp->cohort[0];
+                ++rec.grp->cohort_total;
+            }
+        }
+    }
+
+    rpop = 0;
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        rpop += j->second->cohort_total;
+    }
+}
+
+void Region::cohort_mda(int year, MDAStrat strat){
+    ScopedPhase timer(PHASE_MDA);
+    int population_dt = 28;
+    int n_pop = 0;
+    int n_eligible = 0;
+
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        Group *grp = j->second;
+        n_pop += grp->cohort_total;
+        for(int b = 0; b < (int)grp->cohort.size(); ++b){
+            if(b*population_dt/365.0 >= strat.min_age) n_eligible += grp->cohort[b];
+        }
+    }
+    for(size_t i = 0; i < lingering.size(); ++i){
+        if(lingering[i].age/365.0 >= strat.min_age) ++n_eligible;
+    }
+    if(n_pop == 0 || n_eligible == 0) return;
+
+    //same treatment probability as implement_mda, the drug itself has nothing to act on
+    double target_prop = n_eligible / (double)n_pop;
+    int n_treated = binomial(n_eligible, min(1.0, strat.coverage/target_prop));
+
+    number_treated[year] = n_treated;
+    achieved_coverage[year] = n_treated/(double)n_pop;
+}
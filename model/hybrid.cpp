@@ -0,0 +1,174 @@
+#include "network.h"
+#include <limits>
+#include <math.h>
+
+//Hybrid population (HYBRID_POP). Most people never have worms, so they are only counted, in
+//pools of their night group keyed by day group, bite scale bin and birth bracket. Anyone a
+//pool is visited for (a candidate for a bite, a death or a birth) is given a birth day in the
+//bracket and a bite scale in the bin there and then, so memory goes with the people who have
+//worms. A bitten pooled person becomes an Agent (calc_risk) and goes back into a pool once they
+//have no worms and their antigen has gone (compact_population), keeping only their bin and
+//bracket. Bins and brackets bound chances for EventSkipper, and the drawn age and bite scale
+//decide what happens.
+
+void Region::bld_bite_bins(){
+    vector<double> scales;
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        for(map<int, Agent*>::iterator k = j->second->group_pop.begin(); k != j->second->group_pop.end(); ++k){
+            scales.push_back(k->second->bite_scale);
+        }
+    }
+    if((int)scales.size() < POOL_BITE_BINS) return;
+    sort(scales.begin(), scales.end());
+
+    //bins of equal total bite scale, so the few heavy biters get tight bounds
+    double total = 0;
+    for(size_t i = 0; i < scales.size(); ++i) total += scales[i];
+    bite_edges.clear();
+    double sum = 0;
+    for(size_t i = 0; i < scales.size() && (int)bite_edges.size() < POOL_BITE_BINS - 1; ++i){
+        sum += scales[i];
+        if(sum >= total * (bite_edges.size() + 1) / POOL_BITE_BINS) bite_edges.push_back(scales[i]);
+    }
+    while((int)bite_edges.size() < POOL_BITE_BINS) bite_edges.push_back(scales.back());
+
+    bite_means.assign(POOL_BITE_BINS, 0);
+    vector<int> n(POOL_BITE_BINS, 0);
+    for(size_t i = 0, b = 0; i < scales.size(); ++i){
+        while(scales[i] > bite_edges[b]) ++b;
+        bite_means[b] += scales[i];
+        ++n[b];
+    }
+    for(int b = 0; b < POOL_BITE_BINS; ++b) bite_means[b] = n[b] > 0 ? bite_means[b] / n[b] : bite_edges[b];
+}
+
+void Region::pool_person(Group *ngp, Group *dgp, double bite_scale, int age){
+    int bin = lower_bound(bite_edges.begin(), bite_edges.end(), bite_scale) - bite_edges.begin();
+    if(bin == POOL_BITE_BINS){ //bigger than anyone the bins were made from
+        bin = POOL_BITE_BINS - 1;
+        bite_edges[bin] = bite_scale;
+    }
+    int born = (int)floor((age_clock - age) / (double)POOL_AGE_WIDTH);
+    tuple<int, int, int> key(dgp->gid, bin, born);
+
+    map<tuple<int, int, int>, Group::Pool>::iterator k = ngp->pools.find(key);
+    if(k == ngp->pools.end()){
+        Group::Pool pool;
+        pool.dgp = dgp;
+        pool.bin = bin;
+        pool.born = born;
+        k = ngp->pools.insert(pair<tuple<int, int, int>, Group::Pool>(key, pool)).first;
+        dgp->pool_homes.insert(pair<int, Group*>(ngp->gid, ngp));
+    }
+    ++k->second.count;
+    ++ngp->pooled;
+}
+
+map<tuple<int, int, int>, Group::Pool>::iterator Group::day_pools(int dgid){
+    return pools.lower_bound(tuple<int, int, int>(dgid, 0, numeric_limits<int>::min()));
+}
+
+int Region::pool_age(const Group::Pool& pool){
+    return max(0, age_clock - (pool.born*POOL_AGE_WIDTH + POOL_AGE_WIDTH/2));
+}
+
+int Region::pool_birth(const Group::Pool& pool){
+    int first = pool.born*POOL_AGE_WIDTH;
+    int days = min(POOL_AGE_WIDTH, age_clock - first + 1); //the newest bracket is still filling
+    return first + min(days - 1, int(random_real()*days));
+}
+
+//by rejection from bite_gamma: a bin's candidates are as few as its share of the people, so
+//the draws over a bin stay in proportion to its candidates however narrow it is
+double Region::pool_bite_scale(int bin){
+    double low = bin > 0 ? bite_edges[bin - 1] : 0;
+    if(low >= bite_edges[bin]) return bite_edges[bin];
+    double scale;
+    do scale = bite_gamma(agg_param, 1/agg_param); while(scale <= low || scale > bite_edges[bin]);
+    return scale;
+}
+
+int Region::pooled_under(Group *grp, double min_age){
+    double cut = age_clock - min_age*365; //born after this
+    int under = 0;
+    for(map<tuple<int, int, int>, Group::Pool>::iterator k = grp->pools.begin(); k != grp->pools.end(); ++k){
+        Group::Pool& pool = k->second;
+        int first = pool.born*POOL_AGE_WIDTH;
+        int days = min(POOL_AGE_WIDTH, age_clock - first + 1);
+        int after = min(days, max(0, first + days - 1 - (int)floor(cut)));
+        if(after == days) under += pool.count;
+        else if(after > 0) under += binomial(pool.count, after / (double)days);
+    }
+    return under;
+}
+
+void Region::unpool(Group *ngp, Group::Pool& pool){
+    --pool.count;
+    --ngp->pooled;
+}
+
+Agent *Region::promote(Group *ngp, Group::Pool& pool, int age, double bite_scale){
+    Agent *agt = new Agent(next_aid++, age, bite_scale);
+    agt->ngp = ngp;
+    agt->dgp = pool.dgp;
+    ngp->add_member(agt);
+    pool.dgp->day_population.insert(pair<int, Agent*>(agt->aid, agt));
+    ++lane_epoch;
+
+    unpool(ngp, pool);
+    return agt;
+}
+
+void Region::compact_population(int year, int day){
+    if(bite_edges.empty()) bld_bite_bins();
+    if(bite_edges.empty()) return;
+    double now = year*365 + day;
+    ++lane_epoch;
+
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        Group *grp = j->second;
+        for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end();){
+            Agent *agt = k->second;
+            if(agt->status != 'S' || !agt->wvec.empty() || pow(DAILY_PROB_LOSE_ANT, now - agt->last_mworm_time) > ELIM_ANT_CUTOFF){
+                ++k;
+                continue;
+            }
+            Group *dgrp = groups.size() > 1 ? agt->dgp : grp; //single groups never set day groups
+            pool_person(grp, dgrp, agt->bite_scale, agt->age);
+
+            dgrp->day_population.erase(agt->aid);
+            no_worms_indiv.erase(agt->aid);
+            grp->group_pop.erase(k++);
+            delete agt;
+        }
+    }
+}
+
+void Region::expand_pools(){
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        Group *grp = j->second;
+        for(map<tuple<int, int, int>, Group::Pool>::iterator k = grp->pools.begin(); k != grp->pools.end(); ++k){
+            Group::Pool& pool = k->second;
+            while(pool.count > 0) promote(grp, pool, age_clock - pool_birth(pool), pool_bite_scale(pool.bin));
+        }
+        grp->pools.clear();
+        grp->pool_homes.clear();
+    }
+}
+
+//Bites on a pool, where each person is bitten at rate strength times their exposure and bite
+//scale. Candidates come from the skipper at p_max (at least anyone's chance of a bite in the
+//bin), are given an age and bite scale, and are bitten with their own chance over p_max.
+void Region::pool_bites(Group::Pool& pool, Group *ngp, double strength, double p_max, EventSkipper& bites){
+    int candidates = bites.events(pool.count);
+    for(int c = 0; c < candidates; ++c){
+        int age = age_clock - pool_birth(pool);
+        double bite_scale = pool_bite_scale(pool.bin);
+        double rate = age_exposure(age) * strength * bite_scale;
+        if(random_real() * p_max >= -expm1(-rate)) continue;
+
+        Agent *agt = promote(ngp, pool, age, bite_scale);
+        agt->add_worms(poisson_positive(rate));
+        pre_indiv.insert(pair<int, Agent*>(agt->aid, agt));
+    }
+}
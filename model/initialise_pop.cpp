@@ -1,18 +1,27 @@
 #include "network.h"
 #include "rng.h"
+#include "table.h"
+#include "parallel.h"
 #include <stdio.h>
 #include <string.h>
 #include <cstring>
+#include <math.h>
 
 using namespace std;
 
 //constructer of Region
-Region::Region(int rid, string rname){
+Region::Region(int rid, string rname, string data_dir, string scale_dir, string config_dir, string tran_file){
     this->rid = rid; //region id
     this->rname = rname;
+    this->data_dir = data_dir;
+    this->scale_dir = scale_dir;
+    this->config_dir = config_dir;
+    this->tran_file = tran_file.empty() ? data_dir + TRAN_PARAM : tran_file;
 
     //Trackers for IDs
+    rpop = 0;
     next_aid = 1;
+
     next_gid = 1;
     group_blocks = 0;
 
@@ -26,140 +35,37 @@ Region::Region(int rid, string rname){
     inf_indiv.clear();
 
     //recreate population when there multiple simulations
-    init = pop_reload();
+    ScopedPhase timer(PHASE_BUILD_POP);
+    init = pop_reload(false);
     
     if (!init){ //first simulation and we havent built population before
         read_groups();
+
+        read_parameters(); //bite scales are drawn with agg_param
        
         bld_groups();
        
         bld_region_population();
 
-        //now saving all our config files (to use on other runs!)
-
-        //Saving group meta data
-        string file = CONFIG;   file = file + rname;    file = file + ".init";
-        ofstream out(file.c_str());
-
-        out << std::setprecision(2) << std::setiosflags(std::ios::fixed);
-        
-        out << "TRUE" << endl;
-        out << rpop << endl; //region population
-        out << next_aid << endl; //next agent id
-        out << next_gid << endl; //next group id
-        out << group_blocks << endl; //number of groups
-
-        //saving village names/numbers and locations
-        for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
-            out << j->first << "," << group_numbers[j->first] << "," << j->second->lon << "," << j->second->lat << endl;
-        }
-        out.close();
-
-        //now saving group data, group by group! 
-        for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
-            Group *grp = j->second; //individual group data
-
-            string grp_str = group_numbers[grp->gid]; //group name
-
-            //file name 
-            file = CONFIG_POP;  file = file + grp_str;  file = file + "_pop.init";
-
-            out.open(file.c_str());
-            out << "ID,age" << endl;
-
-            //iterating over agents!
-            for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
-                Agent *agt = k->second;
-                out << agt->aid << "," << agt->age << endl;
-            }
-            out.close();
-        }
+        //now saving the population image (to use on other runs!)
+        save_population();
     }
+    else read_parameters();
 
-    read_parameters();
-
-}
-
-bool Region::pop_reload(){
-
-    //checking if we have already generated the input!
-    string file = CONFIG;   file = file + rname;    file = file + ".init";
-    ifstream in(file.c_str());
-    
-    if(!in) return false;
-
-    string line;
-    getline(in, line);
-    if(line != "TRUE") return false;
-    
-    getline(in, line);      rpop = atoi(line.c_str());
-    getline(in, line);      next_aid = atoi(line.c_str());
-    getline(in, line);      next_gid = atoi(line.c_str());
-    getline(in, line);      group_blocks = atoi(line.c_str());
-    
-    while(getline(in, line)){
-        char *str = new char[line.size()+1];
-        std::strcpy(str, line.c_str());
-        
-        char *p = std::strtok(str, ",");        int id = atoi(p);
-        p = std::strtok(NULL, ",");             string grp = p;
-        p = std::strtok(NULL, ",");             double lon = atof(p);
-        p = std::strtok(NULL, ",");             double lat = atof(p);
-        
-        group_names.insert(pair<string, int>(grp, id));
-        group_numbers.insert(pair<int, string>(id, grp));
-        groups.insert(pair<int, Group*>(id, new Group(id, this, lat, lon)));
-        
-        delete []str;
-    }
-    in.close();
-    
-    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
-        string grp_str = group_numbers[j->first];
-        
-        file = CONFIG_POP;   file = file + grp_str;   file = file + "_pop.init";
-        in.open(file.c_str());
-        
-        string line;
-        getline(in, line);
-        while(getline(in, line)){
-            char *str = new char[line.size()+1];
-            std::strcpy(str, line.c_str());
-            
-            char *p = std::strtok(str, ",");        int id = atoi(p);
-            p = std::strtok(NULL, ",");             int age = atoi(p);
-            
-            Agent *agt = new Agent(id, agg_param, age);
-
-            j->second->add_member(agt);
-            
-            delete []str;
-        }
-        in.close();
-    }
-
-    return true;
+    profile_visit(PHASE_BUILD_POP, rpop);
 }
 
 void Region::read_groups(){
     //function to read in group info!
 
-    ifstream in;
-    string line, file;
-   
-    file = DATADIR; file = file + GROUP_DATA;
-    in.open(file.c_str());
-
-    getline(in, line);          //skip header
+    Table grps(scale_dir + GROUP_DATA);
+    int name_col = grps.col("Group"), pop_col = grps.col("Population"), x_col = grps.col("X"), y_col = grps.col("Y");
 
-    while(getline(in, line)){
-        char* str = new char[line.size()+1];
-        std::strcpy(str, line.c_str());
-        
-        char* p = std::strtok(str, ",");      string name = p;
-        p = std::strtok(NULL, ",");     int pop = atoi(p);
-        p = std::strtok(NULL, ",");     double lat = atof(p);
-        p = std::strtok(NULL, ",");     double log = atof(p);
+    for(int row = 0; row < grps.rows(); ++row){
+        string name = grps.text(row, name_col);
+        int pop = grps.integer(row, pop_col);
+        double lat = grps.num(row, x_col);
+        double log = grps.num(row, y_col);
        
         group_names.insert(pair<string, int>(name, next_gid));
         group_numbers.insert(pair<int, string>(next_gid, name));
@@ -173,28 +79,16 @@ void Region::read_groups(){
         double *r = new double[2];
         r[0] = lat;     r[1] = log;
         group_coords.insert(pair<int, double*>(next_gid++, r));
-        delete []str;
     }
-    in.close();
     
     group_blocks = (int)group_names.size();
 
-    //reading in age distribution
-    file = DATADIR;    file = file + AGE_BRACKETS;
-    in.open(file.c_str());
-    
-    while(getline(in, line)){
-        if(line[0] == '*') continue;
-        if(line.length() <= 1) continue;  //empty line with carriage return
-        break;
+    //reading in age distribution (cumulative, so one more than the brackets)
+    Table ages(data_dir + AGE_BRACKETS);
+    ages.need_rows(N_AGE_GROUPS + 1);
+    for(int ii = 0; ii <= N_AGE_GROUPS; ++ii){
+        age_dist[ii] = ages.num(ii, 0);
     }
-    int ii = 0;
-    
-    while(getline(in, line)){
-        age_dist[ii] = atof(line.c_str());
-        ii++;
-    }
-    in.close();
     
     //calculate cpop
     for(map<int, int>::iterator j = group_pops.begin(); j != group_pops.end(); ++j){
@@ -213,193 +107,62 @@ void Region::bld_groups(){
 
 void Region::bld_region_population(){
 
-    //going village by village
+    //age brackets from the cumulative distribution
+    vector<double> bracket_prob(N_AGE_GROUPS);
+    for(int i = 0; i < N_AGE_GROUPS; ++i) bracket_prob[i] = max(0.0, age_dist[i+1] - age_dist[i]);
+    AliasTable brackets(bracket_prob);
+
+    //each group gets its own IDs and random stream up front, so any number of threads builds the same people
+    vector<Group*> grps;
+    vector<int> first_aid;
     for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
-        Group *grp = j->second;
-        grp->bld_group_pop();
+        grps.push_back(j->second);
+        first_aid.push_back(next_aid);
+        next_aid += group_pops[j->first];
     }
+    parallel_for(grps.size(), BUILD_THREADS, [&](int i){
+        grps[i]->bld_group_pop(first_aid[i], brackets, base_seed);
+    });
 }
 
 void Region::read_parameters(){
     
-    ifstream in;
-    string line, file;
-
-    //reading in birth rate data 
-    file = DATADIR;     file = file + BIRTH_FILE;
-    in.open(file.c_str());
-
-    //skip the description
-    while(getline(in, line)){
-        if(line[0] == '*') continue;
-        if(line.length() <= 1) continue;  //empty line with carriage return
-        break;
+    //reading in birth and mortality rate data, one per age bracket
+    Table births(data_dir + BIRTH_FILE);
+    births.need_rows(N_AGE_GROUPS);
+    for(int ii = 0; ii < N_AGE_GROUPS; ++ii) birth_rate[ii] = births.num(ii, 0);
+
+    Table deaths(data_dir + MORTALITY_FILE);
+    deaths.need_rows(N_AGE_GROUPS);
+    for(int ii = 0; ii < N_AGE_GROUPS; ++ii) mortality_rate[ii] = deaths.num(ii, 0);
+
+    //read exposure by age (the kernel column, as always used)
+    Table exposure(data_dir + EXPOSURE_AGE);
+    int age_col = exposure.col("age"), expo_col = exposure.col("kernel");
+
+    for(int r = 0; r < exposure.rows(); ++r){
+        int age = exposure.integer(r, age_col);
+        if(age < 0 || age > 15) exposure.fail(r, "age must be 0 to 15");
+        exposure_by_age[age] = exposure.num(r, expo_col);
     }
 
-    int ii = 0;
-
-    while(getline(in, line)){
-        birth_rate[ii] = atof(line.c_str());
-        ii++;
+    //worm burden table for seeding (initial prevalence, aggregation)
+    Table initaggs(data_dir + "initaggs.csv", false);
+    init_prev_table.clear();
+    init_k_table.clear();
+    for(int r = 0; r < initaggs.rows(); ++r){
+        init_prev_table.push_back(initaggs.num(r, 0));
+        init_k_table.push_back(initaggs.num(r, 1));
     }
 
-    in.close();
-
-
-     //reading in mortality rate data 
-    file = DATADIR;     file = file + MORTALITY_FILE;
-    in.open(file.c_str());
-
-    //skip the description
-    while(getline(in, line)){
-        if(line[0] == '*') continue;
-        if(line.length() <= 1) continue;  //empty line with carriage return
-        break;
-    }
-
-    ii = 0;
-    while(getline(in, line)){
-        mortality_rate[ii] = atof(line.c_str());
-        ii++;
-    }
-    in.close();
-
-    //read exposure by age
-    file = DATADIR;    file = file + EXPOSURE_AGE;
-    in.open(file.c_str());
-    if(!in){
-        cout << "open " << file << " failed" << endl;
-        exit(1);
-    }
-    getline(in, line);
-    while(getline(in,line)){
-        char *str = new char[line.size()+1];
-        std::strcpy(str, line.c_str());
-        char *p = NULL;
-        p = std::strtok(str, ",");      int age = atoi(p);
-        p = std::strtok(NULL, ",");
-        p = std::strtok(NULL, ",");     double expo = atof(p);
-        
-        exposure_by_age[age] = expo;
-        delete []str;
-    }
-    in.close();
-
-    // Reading road_dst & euclid_dst for multigroup sims
-    // Only if hasn't been loaded yet
-    if (road_dst == nullptr && group_blocks > 1) {
-        int len = group_blocks*(group_blocks-1)/2;
-        cout << "BUILDING ROADS" <<endl;
-        road_dst = new double[len];     memset(road_dst, 0, sizeof(double)*len);
-        euclid_dst = new double[len];   memset(euclid_dst, 0, sizeof(double)*len);
-        
-        file = DATADIR;     file = file + CAR_DISTANCE;
-        in.open(file.c_str());
-        
-        getline(in, line);
-        vector<string> grp_vec;
-        {
-            char *str = new char[line.size()+1];
-            std::strcpy(str, line.c_str());
-            
-            char *p = std::strtok(str, ",");
-            while(p != NULL){
-                grp_vec.push_back(p);
-                p = std::strtok(NULL, ",");
-            }
-            delete []str;
-            
-            while(getline(in, line)){
-                str = new char[line.size()+1];
-                std::strcpy(str, line.c_str());
-                
-                p = std::strtok(str, ",");
-                string src = p;
-                int src_id = group_names[src];
-                
-                int index = 0;
-                p = std::strtok(NULL, ",");
-                while(p != NULL){
-                    string tag = grp_vec[index++];
-                    int tag_id = group_names[tag];
-                    
-                    if(tag_id > src_id){
-                        double dd = atof(p);
-                        
-                        int ii = (src_id-1)*(group_blocks*2-src_id)/2 + tag_id-src_id - 1;
-                        road_dst[ii] = dd;
-                    }
-                    
-                    p = std::strtok(NULL, ",");
-                }
-                delete []str;
-            }
-        }
-        grp_vec.clear();
-        grp_vec.shrink_to_fit();
-        in.close();
-        
-        file = DATADIR;     file = file + CROW_DISTANCE;
-        in.open(file.c_str());
-        
-        getline(in, line);
-        {
-            char *str = new char[line.size()+1];
-            std::strcpy(str, line.c_str());
-            
-            char *p = std::strtok(str, ",");
-            while(p != NULL){
-                grp_vec.push_back(p);
-                p = std::strtok(NULL, ",");
-            }
-            delete []str;
-            
-            while(getline(in, line)){
-                str = new char[line.size()+1];
-                std::strcpy(str, line.c_str());
-                
-                p = std::strtok(str, ",");
-                string src = p;
-                int src_id = group_names[src];
-                
-                int index = 0;
-                p = std::strtok(NULL, ",");
-                while(p != NULL){
-                    string tag = grp_vec[index++];
-                    int tag_id = group_names[tag];
-                    
-                    if(tag_id > src_id){
-                        double dd = atof(p);
-                        
-                        int ii = (src_id-1)*(group_blocks*2-src_id)/2 + tag_id-src_id - 1;
-                        euclid_dst[ii] = dd;
-                    }
-                    
-                    p = std::strtok(NULL, ",");
-                }
-                delete []str;
-            }
-        }
-        in.close();
-    }
-    
     if (ABC_FITTING){
 
-        file = TRAN_PARAM;
-        in.open(file.c_str());
-        getline(in, line);
-        getline(in,line);
-        char *str = new char[line.size()+1];
-        strcpy(str, line.c_str());
-        char *p = NULL;
-    
-        p = strtok(str, " ");      double theta_1 = atof(p);
-        p = strtok(NULL, " ");     double theta_2 = atof(p);
-        p = strtok(NULL, " ");     double k = atof(p);
-        p = strtok(NULL, " ");     double w2n = atof(p);
-
-        delete []str;
-        in.close();
+        Table tran(TRAN_PARAM, true, ' ');
+        tran.need_rows(1);
+        double theta_1 = tran.num(0, 0);
+        double theta_2 = tran.num(0, 1);
+        double k = tran.num(0, 2);
+        double w2n = tran.num(0, 3);
         
         theta1 = theta_1;
         theta2 = theta_2;
@@ -410,23 +173,14 @@ void Region::read_parameters(){
     
     }
     else{
+        Table tran(tran_file);
+
+        double theta_1 = tran.num(0, tran.col("Theta_1"));
+        double theta_2 = tran.num(0, tran.col("Theta_2"));
+        double k = tran.num(0, tran.col("Agg"));
+        double w2n = tran.num(0, tran.col("WorktoNot"));
+
         if (!RUN_OFF_FITTED){ //running from point estimates from Trans-Params
-            file = DATADIR; file = file + TRAN_PARAM;
-            in.open(file.c_str());
-            getline(in,line);
-            getline(in,line);
-            char *str = new char[line.size()+1];
-            strcpy(str, line.c_str());
-            char *p = NULL;
-        
-            p = strtok(str, ",");      double theta_1 = atof(p);
-            p = strtok(NULL, ",");     double theta_2 = atof(p);
-            p = strtok(NULL, ",");     double k = atof(p);
-            p = strtok(NULL, ",");     double w2n = atof(p);
-
-            delete []str;
-            in.close();
-            
             theta1 = theta_1;
             theta2 = theta_2;
             theta3 = 1 / (1 - exp(-theta2));
@@ -436,79 +190,17 @@ void Region::read_parameters(){
        
         }
         else if (RUN_OFF_FITTED){
-                        
-            
-            file = DATADIR; file = file + TRAN_PARAM;
-            
-            in.open(file.c_str());
-            getline(in, line);
-            getline(in,line);
-            char *str = new char[line.size()+1];
-            strcpy(str, line.c_str());
-            char *p = NULL;
-        
-            p = strtok(str, ",");      double theta_1 = atof(p);
-            p = strtok(NULL, ",");     double theta_2 = atof(p);
-            p = strtok(NULL, ",");     double k = atof(p);
-            p = strtok(NULL, ",");     double w2n = atof(p);
-
-            delete []str;
-            in.close();
-            
             theta2 = theta_2;
             theta3 = 1 / (1 - exp(-theta2));
-            //Theta1
-            string loc = "Fitted/Theta1.txt";
-            vector<double> values;
-            int n_values;
-            int w_value;
-
-            file = DATADIR; file = DATADIR + loc;
-            in.open(file.c_str());
-            
-            while(getline(in, line)){
-                values.push_back(atof(line.c_str()));
-            }
-            in.close();
 
-            shuffle(values.begin(),values.end(), gen);
-           
-            theta1 = values[1];
+            //Theta1, Agg and Work are drawn from the fitted samples
+            theta1 = fitted_sample(data_dir + "Fitted/Theta1.txt");
            
-            values.clear();
-            values.shrink_to_fit(); 
-
-            loc = "Fitted/Agg.txt";
-            file = DATADIR; file = DATADIR + loc;
-            in.open(file.c_str());
-          
-            while(getline(in, line)){
-                values.push_back(atof(line.c_str()));
-            }
-            in.close();
-
-            shuffle(values.begin(),values.end(), gen);
-            
-            agg_param = values[1];
+            agg_param = fitted_sample(data_dir + "Fitted/Agg.txt");
             agg_scale = 1 / agg_param;
-            
-            values.clear();
-            values.shrink_to_fit();
            
             if (group_blocks > 1){
-                loc = "Fitted/Work.txt";
-                file = DATADIR; file = DATADIR + loc;
-                in.open(file.c_str());
-
-                while(getline(in, line)){
-                    values.push_back(atof(line.c_str()));
-                }
-                in.close();
-                shuffle(values.begin(),values.end(), gen);
-                worktonot = values[1];
-
-                values.clear();
-                values.shrink_to_fit();
+                worktonot = fitted_sample(data_dir + "Fitted/Work.txt");
             }
             else {
                 worktonot = 0.1; 
@@ -517,29 +209,92 @@ void Region::read_parameters(){
     }
 
     //read in init params
-    file = DATADIR; file = file + INIT_PARAMS;
-    in.open(file.c_str());
-    getline(in,line);
-    getline(in,line);
-    char *str = new char[line.size()+1];
-    strcpy(str, line.c_str());
-    char *p = NULL;
-
-    p = strtok(str, ",");     double init_ls = atof(p);
-    p = strtok(NULL, ",");     double init_mi = atof(p);
-    p = strtok(NULL, ",");     double init_itoa = atof(p);
-    p = strtok(NULL, ",");     double init_ianda = atof(p);
-    delete []str;
-    in.close();
-    
-    init_beta_b = init_ls;
-    init_poisson = init_mi;
-    immature_to_antigen = init_itoa;
-    immature_and_ant = init_ianda;
+    Table init(data_dir + INIT_PARAMS);
+    init_beta_b = init.num(0, init.col("Lifespan"));
+    init_poisson = init.num(0, init.col("Multiple_immature"));
+    immature_to_antigen = init.num(0, init.col("ImtoAnt"));
+    immature_and_ant = init.num(0, init.col("ImandAnt"));
+
+    for(map<string, double>::iterator o = tran_overrides.begin(); o != tran_overrides.end(); ++o) set_parameter(o->first, o->second);
+}
+
+//fills the upper triangle of dst from a square csv of distances with group names along
+//the top and down the side, false if the scale has no such file
+bool Region::read_distances(const string& file, double *dst){
+    Table dist(file, true, ',', false);
+    if(!dist.ok()) return false;
+
+    vector<int> tag_ids;
+    for(size_t c = 1; c < dist.header().size(); ++c){
+        map<string, int>::iterator g = group_names.find(dist.header()[c]);
+        if(g == group_names.end()) dist.fail(-1, "unknown group '" + dist.header()[c] + "'");
+        tag_ids.push_back(g->second);
+    }
+    for(int r = 0; r < dist.rows(); ++r){
+        map<string, int>::iterator g = group_names.find(dist.text(r, 0));
+        if(g == group_names.end()) dist.fail(r, "unknown group '" + dist.text(r, 0) + "'");
+        int src_id = g->second;
+
+        for(int c = 1; c < dist.width(r) && c <= (int)tag_ids.size(); ++c){
+            int tag_id = tag_ids[c - 1];
+            if(tag_id > src_id){
+                int ii = (src_id-1)*(group_blocks*2-src_id)/2 + tag_id-src_id - 1;
+                dst[ii] = dist.num(r, c);
+            }
+        }
+    }
+    return true;
+}
+
+//one value per line, picked at random (as a shuffle then the second value did)
+double Region::fitted_sample(const string& file){
+    Table values(file, false);
+    if(values.rows() < 2) values.fail(values.rows() - 1, "need at least 2 samples");
+    vector<double> v;
+    for(int r = 0; r < values.rows(); ++r) v.push_back(values.num(r, 0));
+    shuffle(v.begin(), v.end(), gen);
+    return v[1];
+}
+
+void Region::coord_distances(double *dst){
+    if((int)groups.size() != group_blocks){ //they would all be left at zero, and cached
+        cout << "Distances between group coordinates are needed before the groups are built" << endl;
+        exit(1);
+    }
+    vector<Group*> grps;
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j) grps.push_back(j->second);
+
+    //same upper triangle indexing as the distance files, a row per source group
+    parallel_for(grps.size(), BUILD_THREADS, [&](int j){
+        Group *src = grps[j];
+        for(size_t k = j + 1; k < grps.size(); ++k){
+            Group *tag = grps[k];
+            int ii = (src->gid-1)*(group_blocks*2-src->gid)/2 + tag->gid-src->gid - 1;
+            dst[ii] = hypot(src->lat - tag->lat, src->lon - tag->lon);
+        }
+    });
 }
 
 void Region::reset_population(){
-   
+    ScopedPhase timer(PHASE_RESET_POP);
+
+    clear_population();
+    if(DEMOG_REPLAYS > 0 && demography.empty()) load_demography();
+
+    if(!pop_reload(true)){
+
+        cout << "reload pop err" << endl;
+        exit(1);
+    }
+    profile_visit(PHASE_RESET_POP, rpop);
+    
+    read_parameters();
+    
+    replay = DEMOG_REPLAYS > 0 ? &demography[replicate % DEMOG_REPLAYS] : nullptr;
+    demog_step = 0;
+}
+
+void Region::clear_population(){
     //resetting population
     pre_indiv.clear();
     inf_indiv.clear();
@@ -562,7 +317,18 @@ void Region::reset_population(){
     group_numbers.clear();
 
     group_pops.clear();
-    
+    parts.clear();                      //they point into the groups
+    night_active.clear();
+    day_active.clear();
+    eliminated = false;
+    lingering.clear();
+    expected_bites = 0;
+    epi_changes = 0;
+    last_epi_dt = EPI_DT;
+
+    age_clock = 0;
+    bite_edges.clear();
+
     // delete[] road_dst;
     // delete[] euclid_dst;
     // euclid_dst = nullptr;
@@ -573,14 +339,11 @@ void Region::reset_population(){
     next_gid = 1;
     group_blocks = 0;
 
-    if(!pop_reload()){
-        cout << "reload pop err" << endl;
-        exit(1);
+    //mda counts are only written in mda years, so clear the last replicate's
+    for(int year = 0; year < SIM_YEARS; ++year){
+        number_treated[year] = 0;
+        achieved_coverage[year] = 0;
     }
-    
-    read_parameters();
-    
-
 }
 
 void Region::reset_prev(){
@@ -627,6 +390,10 @@ Group::Group(int gid, Region *rgn, double lat, double lon){
     this->lon = lon;
 
     this->sum_mf = 0;
+    this->day_strength = 0;
+    this->night_strength = 0;
+    this->day_bites = 0;
+    this->night_bites = 0;
 }
 
 Group::~Group(){
@@ -635,14 +402,8 @@ Group::~Group(){
     for(map<int, Agent*>::iterator j = group_pop.begin(); j != group_pop.end(); ++j)
         delete j->second;
     group_pop.clear();
-    for (auto node : commuting_dist) {
-        delete node;
-    }
-
-    // Clear the vector to remove all pointer elements (now dangling pointers)
-    commuting_dist.clear();
-    commuting_dist.clear();
     day_population.clear();
+
     commuting_pop.clear();
     day_population.clear();
     commuting_cumsum.clear();
@@ -650,29 +411,20 @@ Group::~Group(){
 }
 
 //build individual group populations!
-void Group::bld_group_pop(){
+void Group::bld_group_pop(int first_aid, const AliasTable& brackets, uint64_t stream_key){
 
-    int group_population = rgn->group_pops[gid];
-    double* age_dist = rgn->age_dist;
-    
-    while(group_population > 0 ){
-        double age_p = random_real();
-        for(int i = 0; i < N_AGE_GROUPS; ++i){
-            int lower_bound = WIDTH_AGE_GROUPS*i; //lower bound of our age bracket
-            int upper_bound = WIDTH_AGE_GROUPS*(i+1) - 1; // upper bound of age bracket
-            
-            double ll = age_dist[i];
-            double uu = age_dist[i+1];
-            
-            if ((age_p >= ll) && (age_p < uu)){
-                int id = rgn->next_aid++;
-                int age = 365*(lower_bound + (upper_bound - lower_bound)*random_real()); // age 
-                Agent *agt = new Agent(id,rgn->agg_param,age); //creating new agent of correct age!
-                add_member(agt);
-                break;
-            }
-        }
-        group_population--;
+    mt19937_64 eng;
+    seed_stream(eng, stream_key, gid);
+    double k = rgn->agg_param;
+
+    int group_population = rgn->group_pops.at(gid);
+    for(int n = 0; n < group_population; ++n){
+        int i = brackets.draw(stream_uniform(eng));
+        int lower_bound = WIDTH_AGE_GROUPS*i; //lower bound of our age bracket
+        int upper_bound = WIDTH_AGE_GROUPS*(i+1) - 1; // upper bound of age bracket
+
+        int age = 365*(lower_bound + (upper_bound - lower_bound)*stream_uniform(eng)); // age 
+        add_member(new Agent(first_aid + n, age, stream_gamma(k, 1/k, eng))); //creating new agent of correct age!
     }
 }
 
@@ -0,0 +1,82 @@
+#include "kdtree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+constexpr int KD_LEAF = 8;     //ranges this small are scanned rather than split
+
+struct KDTree::Query{
+    double x, y;
+    size_t k;
+    double cutoff;
+    int skip;
+    vector<pair<double, int>> best;     //max-heap on (distance, index) while k is reached
+
+    //nothing further than this can get in
+    double bound() const{
+        if(k > 0 && best.size() == k) return min(cutoff, best.front().first);
+        return cutoff;
+    }
+
+    void consider(int i, double d){
+        if(i == skip || d > cutoff) return;
+        pair<double, int> p(d, i);
+        if(k > 0 && best.size() == k){
+            if(!(p < best.front())) return;
+            pop_heap(best.begin(), best.end());
+            best.back() = p;
+        }
+        else best.push_back(p);
+        push_heap(best.begin(), best.end());
+    }
+};
+
+KDTree::KDTree(const vector<double>& x, const vector<double>& y) : x(x), y(y){
+    order.resize(x.size());
+    for(size_t i = 0; i < order.size(); ++i) order[i] = i;
+    build(0, order.size(), 0);
+}
+
+void KDTree::build(int lo, int hi, int depth){
+    if(hi - lo <= KD_LEAF) return;
+    int mid = (lo + hi)/2;
+    const vector<double>& c = depth % 2 == 0 ? x : y;
+    //ties by index, so the tree (and every answer) is the same on any platform
+    nth_element(order.begin() + lo, order.begin() + mid, order.begin() + hi, [&c](int a, int b){
+        return c[a] < c[b] || (c[a] == c[b] && a < b);
+    });
+    build(lo, mid, depth + 1);
+    build(mid + 1, hi, depth + 1);
+}
+
+void KDTree::search(int lo, int hi, int depth, Query& q) const{
+    if(hi - lo <= KD_LEAF){
+        for(int n = lo; n < hi; ++n){
+            int i = order[n];
+            q.consider(i, hypot(q.x - x[i], q.y - y[i]));
+        }
+        return;
+    }
+    int mid = (lo + hi)/2;
+    int p = order[mid];
+    q.consider(p, hypot(q.x - x[p], q.y - y[p]));
+
+    double diff = depth % 2 == 0 ? q.x - x[p] : q.y - y[p];
+    if(diff < 0){
+        search(lo, mid, depth + 1, q);
+        if(-diff <= q.bound()) search(mid + 1, hi, depth + 1, q);
+    }
+    else{
+        search(mid + 1, hi, depth + 1, q);
+        if(diff <= q.bound()) search(lo, mid, depth + 1, q);
+    }
+}
+
+void KDTree::nearest(double x, double y, int k, double cutoff, int skip, vector<pair<double, int>>& out) const{
+    Query q{x, y, (size_t)max(k, 0), cutoff > 0 ? cutoff : numeric_limits<double>::infinity(), skip, {}};
+    search(0, order.size(), 0, q);
+    sort(q.best.begin(), q.best.end());
+    out.swap(q.best);
+}
@@ -0,0 +1,32 @@
+#ifndef kdtree_h
+#define kdtree_h
+
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// A 2-d tree over points (group coordinates), for the nearest other groups of
+// each group without an all-pairs distance matrix. Distances are hypot() of the
+// coordinate differences, the same as Region::coord_distances, and ties go to
+// the lower index, so a query that keeps everything matches a stable sort of
+// the full row.
+
+class KDTree{
+public:
+    KDTree(const vector<double>& x, const vector<double>& y);
+
+    //(distance, index) of up to k points nearest (x, y) within cutoff, nearest first;
+    //k 0 for no limit, cutoff <= 0 for none, skip is left out (e.g. the point itself)
+    void nearest(double x, double y, int k, double cutoff, int skip, vector<pair<double, int>>& out) const;
+
+private:
+    vector<double> x, y;
+    vector<int> order;          //points arranged as the tree: median of each range, smaller coordinates to its left
+
+    void build(int lo, int hi, int depth);
+    struct Query;
+    void search(int lo, int hi, int depth, Query& q) const;
+};
+
+#endif /* kdtree_h */
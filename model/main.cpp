@@ -1,65 +1,196 @@
 #include <iostream>
 #include <ctime>
+#include <sstream>
+#include <filesystem>
+#include <limits>
 #include <unistd.h>
 
 #include "main.h"
 #include "mda.h"
+#include "rng.h"
+#include "campaign.h"
 #include "write_netfil_log.h"
+#include "profile.h"
 
 using namespace std;
 
 int sim_i = 0;
 
 string prv_out_loc;
+string out_path; //csv that output_epidemics appends to
+
+#ifndef NETFIL_NO_MAIN // benchmarks and tools link the model without this entry point
+
+//--scale is a folder of data/Scales/ (or any folder with groups.csv), --params a TranParams file
+//or a fitted set of the scale (Theta_1 is data/Fitted/<scale>/Theta_1/TranParams.csv)
+static bool resolve_inputs(const string& scale, const string& params, string& scale_dir, string& tran_file){
+    if(!scale.empty()){
+        scale_dir = string(DATADIR) + "Scales/" + scale + "/";
+        if(!filesystem::exists(scale_dir + GROUP_DATA)) scale_dir = scale + "/";
+        if(!filesystem::exists(scale_dir + GROUP_DATA)){
+            cout << "No scale " << scale << " (no " << GROUP_DATA << " in " << DATADIR << "Scales/" << scale << "/ or " << scale << "/)" << endl;
+            return false;
+        }
+    }
+    if(!params.empty()){
+        tran_file = params;
+        if(!filesystem::is_regular_file(tran_file) && !scale.empty()){
+            tran_file = string(DATADIR) + "Fitted/" + filesystem::path(scale).filename().string() + "/" + params + "/" + TRAN_PARAM;
+        }
+        if(!filesystem::is_regular_file(tran_file)){
+            cout << "No parameter file " << params << endl;
+            return false;
+        }
+    }
+    return true;
+}
 
 int main(int argc, const char * argv[]){
+
     time_t start_time = time(nullptr);
-    prv_out_loc = argv[1];
-   
-    Region *rgn = new Region(region_id, region_name);
-    
+
+    if(argc < 2){
+        cout << "Usage: main <output.csv> [--scale NAME] [--params FILE|Theta_X] [--mda FILE] [--seed S] [--epi-tol TOL] [--validate-step]" << endl;
+        cout << "                         [--crn] [--campaign N_WORKERS] [--shard-size R] [--hosts h1,h2] [--merge]" << endl;
+        cout << "                         [--split L1,L2,... [--split-factor R]] [--mlmc EPS] [--set NAME=VALUE]" << endl;
+        cout << "                         [--sweep SPEC [--design lhs|sobol|saltelli] [--points N] [--sweep-workers W] [--sweep-years Y1,Y2,...]]" << endl;
+        cout << "       main --worker <campaign dir>" << endl;
+        return 1;
+    }
+
+    string worker_dir;
+    int n_workers = -1;    //-1 runs everything in this process
+    int shard_size = 50;   //replicates per shard
+    vector<string> hosts;
+    bool merge_only = false;
+    double epi_tol = EPI_STEP_TOL;
+    bool validate_step = false;
+    vector<double> split_levels;  //--split, m.f. prevalence
+    int split_factor = 4;
+    double mlmc_eps = 0;          //--mlmc, target root mean square error of the yearly prevalence
+    string settings;              //--set NAME=VALUE,...
+    string sweep_spec, design = "saltelli";
+    int sweep_points = 64, sweep_workers = 0;
+    vector<int> sweep_years;      //--sweep outputs, the final year by default
+    string scale, params;
     string mda_data = string(DATADIR) + MDA_PARAMS; // Both are #define macros
 
-    //Counting the number of different simulations we will perform
-    int mda_scenario_count = count_mda_scenarios(mda_data);
-    // cout << "There are " << mda_scenario_count << " scenarios" << endl;
-    
-    //now looping over scenarios
-    for (int scenario_count = 0; scenario_count < mda_scenario_count; ++scenario_count){
-
-        //generating mda strategy!
-        MDAStrat strategy = get_mda_strat(mda_data, scenario_count + 1);
-
-        //Now looping over simulations
-         for (int i = 0; i < strategy.n_sims; ++i){
-            
-            //resetting the populations from previous simulation
-            rgn->reset_population();
-           
-            //run run the simulation year by year
-            for(int year = 0; year < SIM_YEARS; ++year){
-                
-                rgn->sim(year, strategy);
-              
-            }
-
-            sim_i += 1;
+    int first_opt = 1;
+    if(string(argv[1]).rfind("--", 0) != 0){
+        prv_out_loc = argv[1];
+        first_opt = 2;
+    }
+    for(int i = first_opt; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "--seed" && i + 1 < argc) base_seed = stoull(argv[++i]);
+        else if(arg == "--campaign" && i + 1 < argc) n_workers = atoi(argv[++i]);
+        else if(arg == "--shard-size" && i + 1 < argc) shard_size = max(1, atoi(argv[++i]));
+        else if(arg == "--hosts" && i + 1 < argc){
+            stringstream ss(argv[++i]);
+            string host;
+            while(getline(ss, host, ',')) if(!host.empty()) hosts.push_back(host);
+        }
+        else if(arg == "--worker" && i + 1 < argc) worker_dir = argv[++i];
+        else if(arg == "--merge") merge_only = true;
+        else if(arg == "--epi-tol" && i + 1 < argc) epi_tol = atof(argv[++i]);
+        else if(arg == "--validate-step") validate_step = true;
+        else if(arg == "--crn") crn = true;
+        else if(arg == "--profile") profiling = true;
+        else if(arg == "--split" && i + 1 < argc){
+            stringstream ss(argv[++i]);
+            string level;
+            while(getline(ss, level, ',')) if(!level.empty()) split_levels.push_back(atof(level.c_str()));
+        }
+        else if(arg == "--split-factor" && i + 1 < argc) split_factor = atoi(argv[++i]);
+        else if(arg == "--mlmc" && i + 1 < argc) mlmc_eps = atof(argv[++i]);
+        else if(arg == "--set" && i + 1 < argc) settings += (settings.empty() ? "" : ",") + string(argv[++i]);
+        else if(arg == "--sweep" && i + 1 < argc) sweep_spec = argv[++i];
+        else if(arg == "--design" && i + 1 < argc) design = argv[++i];
+        else if(arg == "--points" && i + 1 < argc) sweep_points = atoi(argv[++i]);
+        else if(arg == "--sweep-workers" && i + 1 < argc) sweep_workers = atoi(argv[++i]);
+        else if(arg == "--sweep-years" && i + 1 < argc){
+            stringstream ss(argv[++i]);
+            string year;
+            while(getline(ss, year, ',')) if(!year.empty()) sweep_years.push_back(atoi(year.c_str()));
+        }
+        else if(arg == "--scale" && i + 1 < argc) scale = argv[++i];
+        else if(arg == "--params" && i + 1 < argc) params = argv[++i];
+        else if(arg == "--mda" && i + 1 < argc) mda_data = argv[++i];
+        else{
+            cout << "Unknown option: " << arg << endl;
+            return 1;
+        }
+    }
+    if(!worker_dir.empty() && worker_dir.back() != '/') worker_dir += "/";
+    out_path = string(OUTDIR) + prv_out_loc;
+
+    if(merge_only) return merge_shards(out_path + ".shards/", out_path) ? 0 : 1;
+
+    //without --scale the inputs are whatever setup.sh copied into data/
+    string scale_dir = DATADIR, tran_file;
+    if(!worker_dir.empty()){
+        if(!campaign_inputs(worker_dir, scale_dir, tran_file)){
+            cout << "No campaign in " << worker_dir << endl;
+            return 1;
         }
+    }
+    else if(!resolve_inputs(scale, params, scale_dir, tran_file)) return 1;
+
+    prof.reset("Setup");
+    Region *rgn = new Region(region_id, region_name, DATADIR, scale_dir, CONFIG, tran_file);
+    rgn->epi_tol = epi_tol;
+    if(!apply_settings(rgn, settings)) return 1;
+    Profile setup_profile = prof;
+    vector<Profile> scenario_profiles;
+    vector<ScenarioRun> scenario_runs; //single process runs only, campaign workers keep their own
+
+    if(!worker_dir.empty()) return run_worker(rgn, worker_dir);
+
+    if(validate_step) return validate_epi_step(rgn, out_path, mda_data);
 
+    if(!split_levels.empty()) return run_splitting(rgn, out_path, mda_data, split_levels, split_factor);
+    if(mlmc_eps > 0) return run_mlmc(rgn, out_path, mda_data, mlmc_eps);
+    if(!sweep_spec.empty()){
+        if(sweep_years.empty()) sweep_years.push_back(START_YEAR + SIM_YEARS - 1);
+        return run_sweep(rgn, out_path, mda_data, sweep_spec, design, sweep_points, sweep_workers, sweep_years);
     }
 
+    if(n_workers >= 0 || !hosts.empty()){
+        int status = run_campaign(rgn, out_path, mda_data, max(n_workers, 0), shard_size, hosts,
+                                  filesystem::absolute(argv[0]).string());
+        if(status != 0) return status;
+    }
+    else{
+        //now looping over scenarios, each as one shard
+        vector<Shard> shards = plan_shards(mda_data, numeric_limits<int>::max());
+        for(const Shard& shard : shards){
+
+            //generating mda strategy!
+            MDAStrat strategy = get_mda_strat(mda_data, shard.scenario + 1);
+            prof.reset("Scenario " + to_string(shard.scenario + 1));
+
+            scenario_runs.push_back(run_replicates(rgn, strategy, shard, true));
+            scenario_profiles.push_back(prof);
+        }
+    }
+    if(crn) report_paired(out_path, mda_data);
+
     time_t end_time = time(nullptr);
 
-    string filename = string(OUTDIR) + prv_out_loc;
 #if !ABC_FITTING
     write_netfil(
-        filename,
+        out_path,
         start_time,
         end_time,
         rgn,
-        mda_data
+        mda_data,
+        setup_profile,
+        scenario_profiles,
+        scenario_runs
     );
 #endif
 
+    rgn->wait_for_image();
     return 0;
-} 
\ No newline at end of file
+}
+#endif
@@ -1,68 +1,52 @@
 #include <iostream>
-#include <fstream>
-#include <cstring>
+#include <map>
 #include "mda.h"
+#include "table.h"
 using namespace std;
 
-int count_mda_scenarios(string filename){
-    //counting the number of different MDA scenerios that we are testing!
-
-    ifstream in;
-    string line;
-    
-    in.open(filename.c_str());
-    if(!in){
-        cout << "open " << filename << " failed" << endl;
-        exit(1);
+//one row of an MDA parameter file
+struct MDARow{
+    double coverage, kill_prob, full_ster_prob, part_ster_prob, ster_dur, part_ster_magnitude;
+    int min_age, mda_start_year, mda_num_round, mda_years_between_rounds, num_sims;
+};
+
+//each file is read once, however many scenarios are asked for
+static const vector<MDARow>& read_mda_strats(const string& filename){
+    static map<string, vector<MDARow>> cache;
+    map<string, vector<MDARow>>::iterator found = cache.find(filename);
+    if(found != cache.end()) return found->second;
+
+    Table in(filename);
+    int cov = in.col("Coverage"), kill = in.col("KillProb"), full = in.col("FullSterProb");
+    int part = in.col("PartSterProb"), dur = in.col("SterDuration"), mag = in.col("PartSterMagnitude");
+    int age = in.col("MinAge"), start = in.col("StartYear"), rounds = in.col("NumRounds");
+    int between = in.col("YearsBetweenRounds"), sims = in.col("NumSims");
+
+    vector<MDARow>& rows = cache[filename];
+    for(int r = 0; r < in.rows(); ++r){
+        rows.push_back({in.num(r, cov), in.num(r, kill), in.num(r, full), in.num(r, part), in.num(r, dur), in.num(r, mag),
+                        in.integer(r, age), in.integer(r, start), in.integer(r, rounds), in.integer(r, between), in.integer(r, sims)});
     }
-    int mda_scenario_num {-1}; //Count the number of lines (not including the first, which is just the column titles)
+    return rows;
+}
 
-    while (getline(in, line)){
-        ++mda_scenario_num;
-    }
-    in.close();
-    return mda_scenario_num;
+int count_mda_scenarios(string filename){
+    //counting the number of different MDA scenerios that we are testing!
+    return (int)read_mda_strats(filename).size();
 }
 
 MDAStrat get_mda_strat(string filename, int N)
 {
-    ifstream in;
-    
-    in.open(filename.c_str());
-    if(!in){
-        cout << "open " << filename << " failed" << endl;
+    //scenarios are numbered from 1, as they were lines after the column titles
+    const vector<MDARow>& rows = read_mda_strats(filename);
+    if(N < 1 || N > (int)rows.size()){
+        cout << filename << ": no MDA scenario " << N << " (" << rows.size() << " in the file)" << endl;
         exit(1);
     }
-    
-    string line;
-
-    //skip N lines
-    for(int i = 0; i < N; ++i){
-        getline(in, line);
-    }
-    
-    getline(in,line);
+    const MDARow& row = rows[N - 1];
 
-    char *str = new char[line.size()+1];
-    strcpy(str, line.c_str());
-    char *p = NULL;
-
-    p = strtok(str, ",");       double coverage = atof(p);
-    p = strtok(NULL, ",");      double kill_prob = atof(p);
-    p = strtok(NULL, ",");      double full_ster_prob = atof(p);
-    p = strtok(NULL, ",");      double part_ster_prob = atof(p);
-    p = strtok(NULL, ",");      double ster_dur = atof(p);
-    p = strtok(NULL, ",");      double part_ster_magnitude = atof(p);
-    p = strtok(NULL, ",");      int min_age = atoi(p);
-    p = strtok(NULL, ",");      int mda_start_year = atoi(p);
-    p = strtok(NULL, ",");      int mda_num_round = atoi(p);
-    p = strtok(NULL, ",");      int mda_years_between_rounds = atoi(p);
-    p = strtok(NULL, ",");      int num_sims = atoi(p);
-   
-    delete []str;
-
-    Drugs drug {kill_prob, full_ster_prob, part_ster_prob, ster_dur, part_ster_magnitude};
-    MDAStrat strat {coverage, drug, min_age, mda_start_year, mda_num_round, mda_years_between_rounds, num_sims};
+    Drugs drug {row.kill_prob, row.full_ster_prob, row.part_ster_prob, row.ster_dur, row.part_ster_magnitude};
+    MDAStrat strat {row.coverage, drug, row.min_age, row.mda_start_year, row.mda_num_round, row.mda_years_between_rounds, row.num_sims};
 
     return strat;
-}
\ No newline at end of file
+}
@@ -0,0 +1,148 @@
+#include "campaign.h"
+#include "rng.h"
+#include <chrono>
+#include <math.h>
+#include <limits>
+
+using namespace std;
+
+extern string out_path;
+
+// Multilevel Monte Carlo (--mlmc EPS) for the mean m.f. prevalence at the end of every year.
+// Level l steps the epidemiology every EPI_DT*2^(MLMC_LEVELS-1-l) days, so the last level is
+// the usual EPI_DT. Level 0 is estimated from its own replicates, and level l > 0 from the
+// difference between a replicate at its step and one at the level below from the same seed.
+// With --crn streams (always on here) the pair shares its seeding, demography and treatment
+// draws, and its bites restart from a common stream every 28 days, so the differences vary
+// far less than the prevalence. The estimate is level 0's mean
+// plus the mean differences. Each level's replicate count comes from a pilot of MLMC_PILOT:
+// N_l is proportional to sqrt(V_l/C_l) and large enough that the variance of every year's
+// estimate is at most EPS^2/2. Coarser scales have other agents, so they cannot share streams
+// with a finer one and are not levels.
+
+struct LevelStats{
+    int n = 0;
+    double seconds = 0;                 //for all n samples
+    double fine_seconds = 0;            //of which on runs at this level's step
+    vector<double> sum, sum_sq;         //of the difference (level 0: the prevalence), by year
+    vector<double> fine_sum, fine_sum_sq; //of this level's prevalence alone, for plain Monte Carlo
+
+    LevelStats() : sum(SIM_YEARS), sum_sq(SIM_YEARS), fine_sum(SIM_YEARS), fine_sum_sq(SIM_YEARS) {}
+    double mean(int y) const { return n > 0 ? sum[y]/n : 0; }
+    double var(int y) const { return n > 1 ? max(0.0, (sum_sq[y] - sum[y]*sum[y]/n)/(n - 1)) : 0; }
+    double max_var() const {
+        double v = 0;
+        for(int y = 0; y < SIM_YEARS; ++y) v = max(v, var(y));
+        return v;
+    }
+    double cost() const { return n > 0 ? seconds/n : 0; }
+};
+
+static int level_dt(int level){ return EPI_DT << (MLMC_LEVELS - 1 - level); }
+
+//end of year m.f. prevalence of one replicate stepped every dt days
+static vector<double> run_level(Region *rgn, MDAStrat& strategy, int scenario, int level, int rep, int dt){
+    seed_replicate(scenario, (level << 20) | rep); //the same for both of a pair
+    rgn->fixed_dt = dt;
+    rgn->replicate = rep;
+    rgn->reset_population();
+    vector<double> prev;
+    for(int year = 0; year < SIM_YEARS; ++year){
+        rgn->sim(year, strategy);
+        prev.push_back(mf_prevalence(rgn));
+    }
+    ++prof.replicates;
+    return prev;
+}
+
+static void add_samples(Region *rgn, MDAStrat& strategy, int scenario, int level, int n, LevelStats& s){
+    for(; n > 0; --n){
+        int rep = s.n;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        vector<double> fine = run_level(rgn, strategy, scenario, level, rep, level_dt(level));
+        s.fine_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        vector<double> coarse(SIM_YEARS, 0.0);
+        if(level > 0) coarse = run_level(rgn, strategy, scenario, level, rep, level_dt(level - 1));
+        s.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        ++s.n;
+        for(int y = 0; y < SIM_YEARS; ++y){
+            double d = fine[y] - coarse[y];
+            s.sum[y] += d;
+            s.sum_sq[y] += d*d;
+            s.fine_sum[y] += fine[y];
+            s.fine_sum_sq[y] += fine[y]*fine[y];
+        }
+    }
+}
+
+int run_mlmc(Region *rgn, const string& out_file, const string& mda_data, double eps){
+    if(eps <= 0 || rgn->epi_tol > 0){
+        cout << "--mlmc needs a target error above 0 and the fixed epi step (no --epi-tol)" << endl;
+        return 1;
+    }
+    crn = true;
+    rgn->mlmc = true;
+    ofstream est(out_file + ".mlmc.csv"), lev(out_file + ".mlmc_levels.csv");
+    string rows = out_path;
+    out_path.clear(); //a pair would write its rows twice (out_file may be out_path)
+    est << "scenario,year,prevalence,se" << endl;
+    lev << "scenario,level,epi_dt,n,seconds_per_sample,max_variance,variance_contribution" << endl;
+
+    vector<Shard> shards = plan_shards(mda_data, numeric_limits<int>::max());
+    for(const Shard& shard : shards){
+        MDAStrat strategy = get_mda_strat(mda_data, shard.scenario + 1);
+        vector<LevelStats> levels(MLMC_LEVELS);
+        vector<int> target(MLMC_LEVELS, MLMC_PILOT);
+
+        //pilot, then top up until the counts from the latest variances are met
+        while(true){
+            bool more = false;
+            for(int l = 0; l < MLMC_LEVELS; ++l){
+                if(levels[l].n < target[l]){
+                    add_samples(rgn, strategy, shard.scenario, l, target[l] - levels[l].n, levels[l]);
+                    more = true;
+                }
+            }
+            if(!more) break;
+
+            double spread = 0;
+            for(int l = 0; l < MLMC_LEVELS; ++l) spread += sqrt(levels[l].max_var()*levels[l].cost());
+            for(int l = 0; l < MLMC_LEVELS; ++l){
+                double c = levels[l].cost();
+                int n = c > 0 ? (int)ceil(2/(eps*eps)*sqrt(levels[l].max_var()/c)*spread) : MLMC_PILOT;
+                target[l] = max(levels[l].n, min(MLMC_MAX_SIMS, max(MLMC_PILOT, n)));
+            }
+        }
+
+        double total_seconds = 0;
+        for(int l = 0; l < MLMC_LEVELS; ++l){
+            const LevelStats& s = levels[l];
+            total_seconds += s.seconds;
+            lev << shard.scenario + 1 << "," << l << "," << level_dt(l) << "," << s.n << "," << s.cost() << ","
+                << s.max_var() << "," << s.max_var()/s.n << endl;
+        }
+        for(int y = 0; y < SIM_YEARS; ++y){
+            double mean = 0, var = 0;
+            for(int l = 0; l < MLMC_LEVELS; ++l){
+                mean += levels[l].mean(y);
+                var += levels[l].var(y)/levels[l].n;
+            }
+            est << shard.scenario + 1 << "," << y + START_YEAR << "," << mean << "," << sqrt(var) << endl;
+        }
+
+        //plain Monte Carlo at the finest step: its prevalence variance, at the cost of one run of it
+        const LevelStats& top = levels[MLMC_LEVELS - 1];
+        double fine_var = 0;
+        for(int y = 0; y < SIM_YEARS; ++y){
+            fine_var = max(fine_var, (top.fine_sum_sq[y] - top.fine_sum[y]*top.fine_sum[y]/top.n)/max(top.n - 1, 1));
+        }
+        double plain_seconds = 2*fine_var/(eps*eps)*top.fine_seconds/top.n;
+        cout << "Scenario " << shard.scenario + 1 << ": MLMC took " << total_seconds << " s, plain Monte Carlo at "
+             << EPI_DT << " days would take about " << plain_seconds << " s for the same error" << endl;
+    }
+    rgn->fixed_dt = EPI_DT;
+    rgn->mlmc = false;
+    out_path = rows;
+    return 0;
+}
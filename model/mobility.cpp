@@ -3,66 +3,56 @@
 //radiation model for daily trips between villages
 //radiaiton model from "A universal model for mobility and migration patterns" by Simini et al.
 void Region::radt_model(char m){
-    
-    //deciding which distance we want to use as basis for rad model
-    double *d = NULL;
-    if(m == 'r') d = road_dst;
-    else if (m == 'e') d = euclid_dst;
-    struct _comp_cnode_s{ //comparing distances for sorting
-        bool operator() (const Group::c_node *p, const Group::c_node *q){ return (p->dis < q->dis);}
-    } _smaller;
+    ScopedPhase timer(PHASE_RADT_MODEL);
+
+    //other groups nearest first by the chosen distance, sorted once per scale (scale_cache.cpp)
+    if(commute_type != m) load_commute_order(m);
+
+    double everyone = 0;
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j) everyone += j->second->population();
     
     //iterating over groups
     for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
         Group *src = j->second;
 
         //resetting the previous containers
-        src->commuting_dist.clear();
         src->commuting_pop.clear();
         src->day_population.clear();
         src->commuting_cumsum.clear();
 
         src->total_commute = 0;
 
-        if(src->commuting_dist.size() == 0){ 
-            int src_id = src->gid;
-            for(map<int, Group*>::iterator k = groups.begin(); k != groups.end(); ++k){
-                Group *dst = k->second;
-                int dst_id = dst->gid;
+        int src_id = src->gid;
+        const int *near = &commute_order[commute_start[src_id-1]];
+        int n_dst = commute_start[src_id] - commute_start[src_id-1];
 
-                if(dst_id == src_id) continue; //same group!
-
-                //finding dist index!
-                int index = (min(src_id, dst_id)-1)*(group_blocks*2-min(src_id, dst_id))/2 + abs(dst_id-src_id) - 1;
-                src->commuting_pop.insert(pair<int, double>(dst_id, 0));
-                src->commuting_dist.push_back(new Group::c_node(dst_id, d[index]));                
-            }
-            stable_sort(src->commuting_dist.begin(), src->commuting_dist.end(), _smaller); //sorting 
-        }
-
-        double mi = src->group_pop.size(); //population of current group
+        double mi = src->population(); //population of current group
         double Ti = mi*COMMUTING_PROP; //how many people will be commuting 
         double cum_sum_ceiling = 0.0;
         double com_prop;
         //now looping over all other locations
         double total_move = 0;
         double total_prop = 0;
+        double sij = 0; //see paper (number of people in other groups that live within radius dij (distance from current to target group), exlcuding population from i and j)
 
-        for(int k = 0; k < src->commuting_dist.size(); ++k){
-            Group *dst = groups[src->commuting_dist[k]->gid];  //other group
-            double nj = dst ->group_pop.size(); //other group population
-            double sij = 0; //see paper (number of people in other groups that live within radius dij (distance from current to target group), exlcuding population from i and j)
-            for(int i = 0; i < k; ++i){ //iterating over other groups that have a smaller distance
-                sij += groups[src->commuting_dist[i]->gid]->group_pop.size();
-            } 
+        for(int k = 0; k < n_dst; ++k){
+            Group *dst = groups[near[k]];  //other group
+            double nj = dst->population(); //other group population
             com_prop = mi*nj/(mi+sij)/(mi+nj+sij);
+            sij += nj; //groups are sorted by distance, so sij is a running sum over closer groups
+
             
             total_move += Ti*com_prop;//people from I to J ;
             total_prop += com_prop;
-            src->commuting_pop[src->commuting_dist[k]->gid] = com_prop; //storing prop of people that go from i that go to j 
+            src->commuting_pop[near[k]] = com_prop; //storing prop of people that go from i that go to j 
+
     
         }
 
+        //with only the nearest groups kept, their shares sum to 1 - mi/(mi + sij) rather than 1 - mi/everyone,
+        //so the commuters who would have gone further are shared among the kept groups
+        if(n_dst < group_blocks - 1 && total_prop > 0) total_move *= ((everyone - mi)/everyone) / total_prop;
+
         for(map<int, double>::iterator ii = src->commuting_pop.begin(); ii != src->commuting_pop.end(); ++ii){
             int gid = ii->first;
             cum_sum_ceiling += ii->second/total_prop; 
@@ -1,9 +1,14 @@
 #ifndef network_hpp
 #define network_hpp
+#include <cstdint>
+#include <future>
+#include <memory>
 #include <string>
+#include <tuple>
 
 #include "mda.h"
 #include "agent.h"
+#include "rng.h"
 
 using namespace std;
 
@@ -14,6 +19,7 @@ class Group{
 public:
 
     int gid;                           //Group ID
+    int part = -1;                     //partition that steps it (STEP_PARTITIONS)
     
     double day_strength;            //strength of infection during the day
     double night_strength;           //strength of infection during the day
@@ -28,23 +34,45 @@ public:
     map<int, Agent*> group_pop;       //group population (out of work hours)
 
     //commuting data
-    struct c_node{ //used to store distances to all other groups from current group
-        int gid; //other group idea
-        double dis; //the distance!
-        c_node(int gid, double dis): gid(gid), dis(dis) {}
-    };
-
     double total_commute = 0; //total commuters
 
-    vector<c_node*> commuting_dist; //storing the distances
     map<int, double> commuting_pop; //the prop of commuters from each location
     map<int,double> commuting_cumsum; //cumsum of commuters from each location
     map<int, Agent*> day_population;    //the commuters to current group! and agents from group that did not commute!
 
+    //calc_risk reads people through contiguous lanes of their age exposure and bite scale rather
+    //than through the maps, refilled once Region::lane_epoch has moved on
+    struct Lanes{
+        vector<Agent*> agt;
+        vector<double> exposure;
+        vector<double> scale;
+        vector<double> rate;            //bite rates, worked out lane-wise
+        int epoch = -1;
+    };
+    Lanes night_lanes;                  //of group_pop
+    Lanes day_lanes;                    //of day_population
+
+    //after elimination residents are only counted (see Region::fast_forward)
+    vector<int> cohort;                 //residents by age in 28 day population steps
+    int cohort_total = 0;               //residents, including those in Region::lingering
+
+    //hybrid mode (HYBRID_POP): residents with no worms and no antigen are only counted
+    struct Pool{
+        Group *dgp;                     //day group
+        int bin;                        //bite scale bin (Region::bite_edges)
+        int born;                       //birth bracket, born*POOL_AGE_WIDTH <= birth (Region::age_clock when born)
+        int count = 0;
+    };
+    map<tuple<int, int, int>, Pool> pools;  //keyed by (day group, bin, born)
+    int pooled = 0;                     //residents in pools
+    map<int, Group*> pool_homes;        //night groups with pools of people who spend the day here (some may have emptied)
+    map<tuple<int, int, int>, Pool>::iterator day_pools(int dgid); //first of the pools with day group dgid, which are contiguous
+
+    int population();                   //residents, whether agents or counted
     void add_member(Agent *agt);
     void rmv_member(Agent *agt);
     
-    void bld_group_pop();  //build initial population
+    void bld_group_pop(int first_aid, const AliasTable& brackets, uint64_t stream_key);  //build initial population
   
 
     Group(int gid, Region *rgn, double lat, double lon);
@@ -55,6 +83,10 @@ class Region{
 public:
     int rid;                           //region ID 
     string rname;                      //region name                   
+    string data_dir;                   //shared inputs (rates, params, MDA)
+    string scale_dir;                  //groups.csv and distance matrices of the scale
+    string config_dir;                 //where the population image and other preprocessed artefacts live
+    string tran_file;                  //transmission parameters (TranParams.csv)
     double init_prev;              // initial prevalence
     double init_ratio;
     int rpop;                          //region population
@@ -78,7 +110,7 @@ public:
     double init_beta_b;
     double init_poisson;
 
-    double age_dist[N_AGE_GROUPS];     //container for the age distribution
+    double age_dist[N_AGE_GROUPS + 1]; //cumulative age distribution, one edge per bracket boundary
     int age_dist_lower[N_AGE_GROUPS];
     int age_dist_upper[N_AGE_GROUPS];
     //used to keep track of total population for easy analysis
@@ -105,17 +137,93 @@ public:
     //distances 
     double *euclid_dst;                 //euclidean (L2) distance between groups
     double *road_dst;                   //road (L1) distance between groups
+    uint64_t dist_key = 0;              //hash of the files the distances came from (store.h)
+    vector<int> commute_order;          //the other groups nearest first, group gid's from commute_start[gid-1] to commute_start[gid]
+    vector<int> commute_start;
+    char commute_type = 0;              //distance commute_order is sorted by
 
     map<int, int> group_pops;           //pop in each group
+
+    map<int, Group*> night_active;      //groups with an infected resident (non-zero night strength)
+    map<int, Group*> day_active;        //groups with an infected agent there during the day
+
  
     double mortality_rate[N_AGE_GROUPS];                //mortatlity rates
     double birth_rate[N_AGE_GROUPS];
     double exposure_by_age[16];
+    vector<double> init_prev_table;     //initaggs.csv, antigen prevalence
+    vector<double> init_k_table;        //and the aggregation that gives it
+
+    //elimination fast forward (ELIM_FAST_FORWARD)
+    struct AntRecord{                   //someone whose antigen has not decayed yet
+        Group *grp;
+        int age;
+        double last_mworm_time;
+    };
+    bool eliminated = false;            //no worms left, agents replaced by cohorts
+    vector<AntRecord> lingering;
+
+    //partitioned stepping (STEP_PARTITIONS, partition.cpp): a partition owns its groups' residents,
+    //their status sets and a random stream, so partitions step in parallel and nothing depends on
+    //which thread steps which. Only day strengths cross partitions, and are added up in order.
+    struct Partition{
+        vector<Group*> groups;          //by gid
+        map<int, Agent*> pre_indiv;     //as the region's, for these residents
+        map<int, Agent*> inf_indiv;
+        map<int, Agent*> uninf_indiv;
+        RngStream stream;
+        ProfileCounters counters;       //added to prof after every phase
+        uint64_t visits = 0;            //agents visited, likewise
+
+        map<int, double> day_out;       //infectiousness residents take to each day group (by gid)
+        map<int, Group*> day_active;    //own groups with a day strength
+        double expected_bites = 0;
+        int changes = 0;                //status changes at the last update
+        vector<Agent*> deaths;
+        vector<int> births;             //per group
+        int under_min = 0, treated = 0; //MDA
+    };
+    vector<Partition> parts;            //empty when the replicate is stepped whole
+
+    //demography replay (DEMOG_REPLAYS, demography.cpp)
+    struct Demography{                  //deaths, births and day groups of one simulated trajectory
+        vector<int32_t> death_start {0};    //population step s has deaths [death_start[s], death_start[s+1])
+        vector<int32_t> deaths;             //(night group, aid) of each
+        vector<int32_t> birth_start {0};
+        vector<int32_t> births;             //group of each baby, whose aid is next_aid at the time
+        vector<int32_t> commute_years;
+        vector<int32_t> commute_start {0};  //day groups of commute_years[c] are [commute_start[c], commute_start[c+1])
+        vector<int32_t> commute;            //day group of everyone, groups and their people in order
+    };
+    vector<Demography> demography;      //loaded at the first reset
+    int replicate = 0;                  //set by run_replicates, picks the trajectory replayed
+    const Demography *replay = nullptr; //this replicate's, nullptr when demography is drawn live
+    Demography *recording = nullptr;    //while simulating one
+    int demog_step = 0;                 //population steps replayed so far
+
+    //hybrid population (HYBRID_POP)
+    int age_clock = 0;                  //days everyone has aged this replicate, pools count births from it
+    vector<double> bite_edges;          //largest bite scale in each bin
+    vector<double> bite_means;          //mean bite scale in each bin, for the bite denominators
+
+    int lane_epoch = 0;                 //moved on by every step that changes who is where, their age or bite scale (Group::Lanes)
+
+    //adaptive epi step (Region::epi_step)
+    double epi_tol = EPI_STEP_TOL;
+    int fixed_dt = EPI_DT;              //step without epi_tol, longer on coarse MLMC levels (mlmc.cpp)
+    bool mlmc = false;                  //running MLMC pairs, whose bites restart every 28 days (mlmc.cpp)
+    string settings;                    //--set NAME=VALUE,... applied, for campaign workers
+    map<string, double> tran_overrides; //TranParams columns set at run time, kept when read_parameters rereads the file
+    double expected_bites = 0;          //infective bites per EPI_DT at the last calc_risk
+    int epi_changes = 0;                //status changes at the last update_epi_status
+    int last_epi_dt = EPI_DT;
+    uint64_t epi_steps = 0;             //update_epi_status calls, counted for --validate-step
 
     double achieved_coverage[SIM_YEARS]; // the actual drug coverage achieved each year (for each year of the simulation). Will be zero for most years.
     int number_treated[SIM_YEARS];
 
-    Region(int rid, string rname);
+    Region(int rid, string rname, string data_dir = DATADIR, string scale_dir = DATADIR, string config_dir = CONFIG,
+           string tran_file = "");      //tran_file defaults to data_dir + TRAN_PARAM
 
     //Functions that run on region
     void sim(int year, MDAStrat strategy);                     //wrapper to run simulation
@@ -123,22 +231,78 @@ public:
     void remove_agent(Agent *agt);                                   //remove dead people from population
     void radt_model(char m);                                    //radiation model for daily trips (work/school)
     //void hndl_migrt(int day);                                //TODO long term migration between groups (to help avoid groups that have died out)
-    void renew_pop(int year, int day, int dt);
-    void handle_birth(int year, int day, int dt);                         // handle new births
-    void calc_risk();         //find prevalence in each village
+    void renew_pop(int dt);
+    void handle_birth(int dt);                         // handle new births
+    void calc_risk(double steps = 1);   //find prevalence in each village, bites for steps*EPI_DT days
+    int epi_step(int year, int day, MDAStrat& strat);           //days until the next epi update
+
     void update_epi_status(int year, int day, int dt);                  //update agent's epi status
+    int update_status_sets(map<int, Agent*>& pre, map<int, Agent*>& uninf, map<int, Agent*>& inf,
+                           int year, int day, int dt);                  //returns the status changes
+    size_t status_count(char status);   //people in pre_indiv (E), uninf_indiv (U) or inf_indiv (I), or the partitions' sets
     void seed_lf();                                             //seed LF in population
+    void seed_initial_infection();                              //seed until prev and ratio within bounds
     double mf_functional_form(char form, double worm_strength);            //converts worm strength to mf load
+    double age_exposure(int age);                               //relative exposure by age in days
+    Group::Lanes& lanes(Group::Lanes& l, map<int, Agent*>& people);    //l, refilled from people if stale
+    double lane_bite_sum(Group::Lanes& l);                      //bite denominator, in the maps' order
+    void lane_bites(Group::Lanes& l, double strength, double share, map<int, Agent*>& pre);    //newly exposed into pre
 
     void implement_mda(int year, MDAStrat strat);           //MDA!
+
+    void split_partitions();                                    //spatial partitions of the groups, once seeded
+    void part_calc_risk(double steps);                          //the steps above, partition by partition
+    void part_update_epi(int year, int day, int dt);
+    void part_renew_pop(int dt);
+    void part_handle_birth(int dt);
+    void part_mda(int year, MDAStrat strat);
+
+    void start_fast_forward(int year, int day);                 //turn agents into cohorts once eliminated
+    void fast_forward(int year, int first_day, MDAStrat strat); //rest of the year without agents
+    void cohort_demography(int year, int day, int dt);          //deaths, ageing and births of cohorts
+    void cohort_mda(int year, MDAStrat strat);                  //treatment counts only, nobody has worms
+
+    void compact_population(int year, int day);                 //move people without worms or antigen into pools
+    void bld_bite_bins();                                       //bite scale bins from the current agents
+    void pool_person(Group *ngp, Group *dgp, double bite_scale, int age);
+    int pool_age(const Group::Pool& pool);                      //age in the middle of the pool's bracket
+    int pool_birth(const Group::Pool& pool);                    //birth day of someone in the pool, even over its bracket
+    double pool_bite_scale(int bin);                            //bite scale of someone in the bin, as bite_gamma draws them
+    int pooled_under(Group *grp, double min_age);               //pooled residents under min_age years
+    void unpool(Group *ngp, Group::Pool& pool);                 //drop someone from a pool
+    Agent *promote(Group *ngp, Group::Pool& pool, int age, double bite_scale); //take someone out of a pool as an agent
+    void pool_bites(Group::Pool& pool, Group *ngp, double strength, double p_max, EventSkipper& bites);
+    void expand_pools();                                        //everyone back to agents
     
-    bool pop_reload();
+    uint64_t pop_key();                                 //hash of the inputs the population is built from
+    bool pop_reload(bool redraw_bites);                 //false if there is no image for these inputs
+    bool pop_parse(const char *data, size_t size, uint64_t key, const string& file, bool redraw_bites);
+
+    void save_population();                             //write the population image (pop_image.cpp) in the background
+    void wait_for_image();                              //until that write is done
+    future<void> image_written;
+    shared_ptr<const vector<char>> built_image;         //the image this run built, later resets read it rather than the file
+
     void read_groups();                                 //read input data
     void bld_groups();                                  //build the model groups 
     void bld_region_population();//build the population of the region
     void read_parameters();
+    void coord_distances(double *dst);                  //euclidean distances from group coords (if no distance file)
+    bool read_distances(const string& file, double *dst);   //false if the scale has no such file
+    void load_distances();                              //from the binary cache, or read and cache them
+    void load_commute_order(char m);                    //sorted destinations for radt_model, cached the same way
+    void nearest_commute_order();                       //only the nearest (SPARSE_COMMUTE), from a k-d tree
+
+    double fitted_sample(const string& file);           //random draw from a Fitted/ file
+    bool set_parameter(const string& name, double value);   //a TranParams column or an inline constant of params.h (sweep.cpp), false if neither
 
     void reset_population();
+    void clear_population();                            //everyone and every group gone
+    uint64_t demog_key();                               //hash of what the demography depends on
+    void load_demography();                             //from the cache, or simulate and save it
+    void replay_deaths(int dt);
+    void replay_births();
+    void replay_commute(int year);
     void reset_prev();
     void output_epidemics(int year, int day, MDAStrat strategy);    //output outbreak data
     int factorial(int n);
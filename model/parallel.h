@@ -0,0 +1,32 @@
+#ifndef parallel_h
+#define parallel_h
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Runs f(i) for i in [0, n) on up to `threads` threads (0 for every core).
+// Items are handed out one at a time, so f must not depend on which thread
+// runs it or in what order; anything random takes its own stream (rng.h).
+template <typename F>
+void parallel_for(int n, int threads, F f){
+    if(threads <= 0) threads = max(1u, thread::hardware_concurrency());
+    threads = min(threads, n);
+    if(threads <= 1){
+        for(int i = 0; i < n; ++i) f(i);
+        return;
+    }
+    atomic<int> next(0);
+    vector<thread> pool;
+    for(int t = 0; t < threads; ++t){
+        pool.emplace_back([&]{
+            for(int i = next++; i < n; i = next++) f(i);
+        });
+    }
+    for(thread& th : pool) th.join();
+}
+
+#endif /* parallel_h */
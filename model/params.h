@@ -14,14 +14,17 @@
 
 using namespace std;
 
-constexpr double IMMATURE_PERIOD_MEAN     = 30*9;   //mean immature period
-constexpr double IMMATURE_PERIOD_MEAN_STD = 30*0.1; //STD dev of immature period
+// Model constants declared inline double (not constexpr) can be changed at run time with
+// --set NAME=VALUE or swept with --sweep (sweep.cpp).
 
-constexpr double MATURE_PERIOD_MEAN       = 364*5;   //mean mature period
-constexpr double MATURE_PERIOD_MEAN_STD   = 364*0.1; //STD dev of mature period
+inline double IMMATURE_PERIOD_MEAN     = 30*9;   //mean immature period
+inline double IMMATURE_PERIOD_MEAN_STD = 30*0.1; //STD dev of immature period
 
-constexpr double PROPORTION_MALE_WORM  = 0.5; //proportion of worms that are male
-constexpr double PROPORTION_MALE_AGENT = 0.5; //proportion of agents that are male
+inline double MATURE_PERIOD_MEAN       = 364*5;   //mean mature period
+inline double MATURE_PERIOD_MEAN_STD   = 364*0.1; //STD dev of mature period
+
+inline double PROPORTION_MALE_WORM  = 0.5; //proportion of worms that are male
+inline double PROPORTION_MALE_AGENT = 0.5; //proportion of agents that are male
 
 // Potential improvement: infer number of age groups from pop_age_dists.csv?
 constexpr int N_AGE_GROUPS    = 16; //number of 5-year age brackets (for seeding pop)
@@ -33,31 +36,88 @@ constexpr int SIM_YEARS = 7;
 constexpr int SIM_YEARS = 21;
 #endif
 
-constexpr double INIT_PREV_MIN = 3.15;  // Minimum initial antigen prev
-constexpr double INIT_PREV_MAX = 3.35;  // Maximum initial antigen prev
+inline double INIT_PREV_MIN = 3.15;  // Minimum initial antigen prev
+inline double INIT_PREV_MAX = 3.35;  // Maximum initial antigen prev
 
-constexpr double INIT_RATIO_MIN = 0.155;
-constexpr double INIT_RATIO_MAX = 0.175;
+inline double INIT_RATIO_MIN = 0.155;
+inline double INIT_RATIO_MAX = 0.175;
 
-constexpr double ANT_0  = 0.0325;   // Initial antigen prev
-constexpr double SIGMA_G = 1.1311;  // Household standard dev
-constexpr double BETA_0  = -3.9515; // For seeding somehow..
+inline double ANT_0  = 0.0325;   // Initial antigen prev
+inline double SIGMA_G = 1.1311;  // Household standard dev
+inline double BETA_0  = -3.9515; // For seeding somehow..
 
 constexpr int START_YEAR = 2010; // Model starting year
 
-constexpr double COMMUTING_PROP      = 0.5;          //proportion of group that commute daily (over 5 years old)
+inline double    COMMUTING_PROP      = 0.5;          //proportion of group that commute daily (over 5 years old)
 constexpr int    RECALC_YEARS        = 100;           //how often we want to recalc commuters
 constexpr char   DISTANCE_TYPE       = 'r';           // r for road distance, e for euclidean
-constexpr double DAILY_PROB_LOSE_ANT = 0.992327946;  //set so the half-life is 90 days i.e. pow(0.5,1/90)
+constexpr int    COMMUTE_K           = 0;             //commute only to this many nearest groups (k-d tree on coordinates, no distance matrix), 0 for all
+constexpr double COMMUTE_CUTOFF      = 0;             //or only to groups within this distance (metres), 0 for no cutoff
+constexpr bool   SPARSE_COMMUTE      = COMMUTE_K > 0 || COMMUTE_CUTOFF > 0;
+
+inline double    DAILY_PROB_LOSE_ANT = 0.992327946;  //set so the half-life is 90 days i.e. pow(0.5,1/90)
+
+constexpr char   ELIM_FAST_FORWARD   = 'c';          //once no worms are left: c project demography by age cohort, s stop (population frozen), anything else keep simulating agents
+constexpr double ELIM_ANT_CUTOFF     = 1e-9;         //people whose chance of still being antigen positive is above this are kept individually
+
+constexpr bool   HYBRID_POP          = false;        //hold people with no worms and no antigen as counts per (group, day group, age, bite bin)
+constexpr int    POOL_AGE_WIDTH      = 364;          //days of birth per pooled age bracket
+constexpr int    POOL_BITE_BINS      = 16;           //bins of bite scale (equal total scale) for pooled people
+
+constexpr int    EPI_DT              = 7;            //fixed epi step (days), bite rates in calc_risk are per EPI_DT
+constexpr double EPI_STEP_TOL        = 0;            //adaptive epi step: expected status changes per step as a share of the infected (--epi-tol), 0 keeps EPI_DT
+constexpr int    EPI_DT_MIN          = 3;            //shortest adaptive step (days)
+constexpr int    EPI_DT_MAX          = 28;           //longest adaptive step (days)
+constexpr int    EPI_MDA_DAYS        = 56;           //days after an MDA round stepped at EPI_DT_MIN
+
+constexpr int    BUILD_THREADS       = 0;            //threads for a first-time population and scale build, 0 for every core
+constexpr int    STEP_PARTITIONS     = 0;            //step a replicate as this many spatial partitions of groups (partition.cpp), 0 steps it whole
+constexpr int    STEP_THREADS        = 0;            //threads stepping the partitions, 0 for every core (results do not depend on it)
+constexpr int    DEMOG_REPLAYS       = 0;            //replicates replay one of this many demographies simulated once per scale (demography.cpp), 0 draws it live
+
+constexpr double STOP_ELIM_WIDTH     = 0;            //a scenario stops once the 95% interval of its final-year elimination probability has this half-width, 0 runs NumSims
+constexpr double STOP_PREV_WIDTH     = 0;            //and that of its final-year mean m.f. prevalence this one (both if both are set)
+constexpr int    STOP_MIN_SIMS       = 20;           //replicates before a scenario may stop, NumSims is the most
+
+constexpr int    MLMC_LEVELS         = 3;            //--mlmc epi steps EPI_DT*2^k, k = MLMC_LEVELS-1 down to 0 (mlmc.cpp)
+constexpr int    MLMC_PILOT          = 10;           //replicates (pairs) per level before the counts are chosen
+constexpr int    MLMC_MAX_SIMS       = 2000;         //most per level
+
+constexpr int    EMU_FEATURES        = 150;          //random Fourier features of the fitting emulator (tools/emulator.cpp)
+constexpr double EMU_LENGTHSCALE     = 0.25;         //of its squared exponential kernel, with each prior range scaled to 1
+constexpr double EMU_Z               = 3;            //a candidate is rejected if it misses the tolerance even this many sds towards the targets
+constexpr int    EMU_MIN_RUNS        = 30;           //runs added before it rejects anything
+constexpr double EMU_T1_MAX          = 0.01;         //prior ranges (from 0) of theta1, k and worktonot, as R/abc_raster.R
+constexpr double EMU_K_MAX           = 0.3;
+constexpr double EMU_W_MAX           = 0.8;
+
+constexpr int    SWEEP_BOOTSTRAP     = 1000;         //bootstrap resamples for the 95% intervals of Sobol indices (--sweep, sweep.cpp)
 
 // ABC_FITTING must remain a #define — it is used in a preprocessor #if directive
 #define ABC_FITTING false
 
 constexpr bool RUN_OFF_FITTED = false;
 
+constexpr bool PROFILE_PERF_EVENTS = false;  //with --profile, also read cpu cycles & cache misses with perf_event_open (linux only)
+
 double random_real();
 double normal(double mean, double stddev);
 int poisson(double rate);
+int binomial(int n, double p);
+int poisson_positive(double rate);
+void fill_uniform(double *out, int n);  //bulk draws, same streams as random_real and normal
+
+//walks through people who each have an event with probability p, jumping between
+//events so random numbers are drawn per event rather than per person
+struct EventSkipper{
+    double log_q;   //log(1 - p)
+    double next;    //index of the next person with an event
+    double seen;    //people passed so far
+    EventSkipper(double p);
+    int events(int n);  //events among the next n people
+    void positions(int n, vector<int>& at); //which of the next n people (0 to n-1) have events
+};
+
 double bite_gamma(double shape, double scale);
 double init_beta(double a, double b); 
 void partial_shuffle(vector<double>& vec, int start, int end);
@@ -66,13 +126,11 @@ void partial_shuffle(vector<double>& vec, int start, int end);
     #define DATADIR "../LF2/data/"
     #define OUTDIR ""
     #define CONFIG "../LF2/$config/"
-    #define CONFIG_POP "../LF2/$config/pop/"
     #define TRAN_PARAM "TranParams-temp"
 #else
     #define DATADIR "../data/"
     #define OUTDIR "../output/"
     #define CONFIG "../$config/"
-    #define CONFIG_POP "../$config/pop/"
     #define TRAN_PARAM "TranParams.csv"
 #endif
 
@@ -0,0 +1,301 @@
+#include "network.h"
+#include "parallel.h"
+#include <math.h>
+
+//Partitioned stepping (STEP_PARTITIONS). The groups are split spatially into a fixed number
+//of partitions. A partition owns the residents of its groups: their status sets, bites,
+//worms, deaths and births, all drawn from the partition's own stream, so partitions can step
+//on any threads. Commuters are the only link, they take infectiousness to day groups of other
+//partitions. calc_risk first has every partition total what its residents take to each day
+//group, then the owner of each day group adds those totals in partition order. Deaths and
+//births that touch other partitions' day populations, and the agent IDs of babies, are done
+//in partition order once every partition has drawn its own. So the results depend on
+//STEP_PARTITIONS, but not on STEP_THREADS or which thread steps what.
+
+static_assert(!(HYBRID_POP && STEP_PARTITIONS > 0), "pools are not partitioned, use HYBRID_POP or STEP_PARTITIONS");
+
+//f(i) for every partition on its own stream and counters, which are then added up in order
+template <typename F>
+static void run_parts(vector<Region::Partition>& parts, ProfilePhase phase, F f){
+    parallel_for(parts.size(), STEP_THREADS, [&](int i){
+        RngStream *stream = cur_stream;
+        ProfileCounters *counters = prof_counters;
+        cur_stream = &parts[i].stream;
+        prof_counters = &parts[i].counters;
+        f(i);
+        cur_stream = stream;
+        prof_counters = counters;
+    });
+    for(size_t i = 0; i < parts.size(); ++i){
+        Region::Partition& p = parts[i];
+        prof.counters.bites += p.counters.bites;
+        prof.counters.worms_created += p.counters.worms_created;
+        prof.counters.worms_destroyed += p.counters.worms_destroyed;
+        p.counters = ProfileCounters();
+        profile_visit(phase, p.visits);
+        p.visits = 0;
+    }
+}
+
+//groups [lo, hi) to partitions [first, first + n), halving across the wider extent by residents
+static void bisect(vector<Group*>& grps, int lo, int hi, int first, int n){
+    if(n == 1 || hi - lo <= 1){
+        for(int i = lo; i < hi; ++i) grps[i]->part = first;
+        return;
+    }
+    double min_x = grps[lo]->lat, max_x = min_x, min_y = grps[lo]->lon, max_y = min_y;
+    double total = 0;
+    for(int i = lo; i < hi; ++i){
+        min_x = min(min_x, grps[i]->lat);
+        max_x = max(max_x, grps[i]->lat);
+        min_y = min(min_y, grps[i]->lon);
+        max_y = max(max_y, grps[i]->lon);
+        total += grps[i]->group_pop.size();
+    }
+    bool by_x = max_x - min_x >= max_y - min_y;
+    sort(grps.begin() + lo, grps.begin() + hi, [by_x](Group *a, Group *b){
+        double ca = by_x ? a->lat : a->lon, cb = by_x ? b->lat : b->lon;
+        return ca < cb || (ca == cb && a->gid < b->gid);
+    });
+
+    int n_low = n/2;
+    double target = total*n_low/n, low = 0;
+    int mid = lo + 1;
+    for(; mid < hi - 1 && low + grps[mid - 1]->group_pop.size() < target; ++mid) low += grps[mid - 1]->group_pop.size();
+    bisect(grps, lo, mid, first, n_low);
+    bisect(grps, mid, hi, first + n_low, n - n_low);
+}
+
+void Region::split_partitions(){
+    vector<Group*> grps;
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j) grps.push_back(j->second);
+    bisect(grps, 0, grps.size(), 0, STEP_PARTITIONS);
+
+    parts.assign(STEP_PARTITIONS, Partition());
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        Partition& p = parts[j->second->part];
+        p.groups.push_back(j->second);
+        p.births.push_back(0);
+    }
+
+    //streams follow from the replicate's, whatever the threads
+    uint64_t key = gen();
+    key = (key << 32) | gen();
+    for(int i = 0; i < STEP_PARTITIONS; ++i) seed_stream(parts[i].stream, key, i);
+
+    for(map<int, Agent*>::iterator j = pre_indiv.begin(); j != pre_indiv.end(); ++j) parts[j->second->ngp->part].pre_indiv.insert(*j);
+    for(map<int, Agent*>::iterator j = inf_indiv.begin(); j != inf_indiv.end(); ++j) parts[j->second->ngp->part].inf_indiv.insert(*j);
+    for(map<int, Agent*>::iterator j = uninf_indiv.begin(); j != uninf_indiv.end(); ++j) parts[j->second->ngp->part].uninf_indiv.insert(*j);
+    pre_indiv.clear();
+    inf_indiv.clear();
+    uninf_indiv.clear();
+}
+
+size_t Region::status_count(char status){
+    map<int, Agent*> Partition::*set = status == 'E' ? &Partition::pre_indiv : status == 'I' ? &Partition::inf_indiv : &Partition::uninf_indiv;
+    size_t n = status == 'E' ? pre_indiv.size() : status == 'I' ? inf_indiv.size() : uninf_indiv.size();
+    for(size_t i = 0; i < parts.size(); ++i) n += (parts[i].*set).size();
+    return n;
+}
+
+void Region::part_calc_risk(double steps){
+    ScopedPhase timer(PHASE_CALC_RISK);
+
+    char form = 'l'; //as calc_risk
+    bool single = groups.size() == 1;
+
+    //night strengths, and what residents take to their day groups
+    run_parts(parts, PHASE_CALC_RISK, [&](int i){
+        Partition& p = parts[i];
+        for(size_t g = 0; g < p.groups.size(); ++g){
+            p.groups[g]->night_strength = 0;
+            p.groups[g]->day_strength = 0;
+        }
+        p.day_out.clear();
+        p.day_active.clear();
+        p.expected_bites = 0;
+
+        map<int, Group*> night_active;
+        for(map<int, Agent*>::iterator j = p.inf_indiv.begin(); j != p.inf_indiv.end(); ++j){
+            night_active.insert(pair<int, Group*>(j->second->ngp->gid, j->second->ngp));
+        }
+        for(map<int, Group*>::iterator j = night_active.begin(); j != night_active.end(); ++j){
+            Group *grp = j->second;
+            grp->night_bites = lane_bite_sum(lanes(grp->night_lanes, grp->group_pop));
+            p.visits += grp->group_pop.size();
+        }
+        for(map<int, Agent*>::iterator j = p.inf_indiv.begin(); j != p.inf_indiv.end(); ++j){
+            Agent *agt = j->second;
+            double x = age_exposure(agt->age)*agt->bite_scale*mf_functional_form(form, agt->worm_strength);
+            p.expected_bites += x;
+            agt->ngp->night_strength += x / agt->ngp->night_bites;
+            if(!single) p.day_out[agt->dgp->gid] += x;
+        }
+        for(map<int, Group*>::iterator j = night_active.begin(); j != night_active.end(); ++j) j->second->night_strength *= steps;
+    });
+
+    //day strengths: each partition adds up everyone's share of its own day groups, in partition order
+    run_parts(parts, PHASE_CALC_RISK, [&](int i){
+        Partition& p = parts[i];
+        for(size_t q = 0; q < parts.size(); ++q){
+            for(map<int, double>::iterator j = parts[q].day_out.begin(); j != parts[q].day_out.end(); ++j){
+                Group *grp = groups.find(j->first)->second;
+                if(grp->part != i) continue;
+                grp->day_strength += j->second;
+                p.day_active.insert(pair<int, Group*>(grp->gid, grp));
+            }
+        }
+        for(map<int, Group*>::iterator j = p.day_active.begin(); j != p.day_active.end(); ++j){
+            Group *grp = j->second;
+            grp->day_bites = lane_bite_sum(lanes(grp->day_lanes, grp->day_population));
+            grp->day_strength *= steps / grp->day_bites;
+            p.visits += grp->day_population.size();
+        }
+    });
+
+    expected_bites = 0;
+    for(size_t i = 0; i < parts.size(); ++i) expected_bites += parts[i].expected_bites;
+
+    //bites, everyone from their own partition's stream
+    double night_share = single ? 1.0 : 1.0 - worktonot;
+    run_parts(parts, PHASE_CALC_RISK, [&](int i){
+        Partition& p = parts[i];
+        for(size_t g = 0; g < p.groups.size(); ++g){
+            Group *grp = p.groups[g];
+            p.visits += grp->group_pop.size();
+            for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
+                Agent *agt = k->second;
+                char prev_status = agt->status;
+                if(grp->night_strength > 0) agt->sim_bites(age_exposure(agt->age) * grp->night_strength * agt->bite_scale * night_share);
+                if(!single && agt->dgp->day_strength > 0) agt->sim_bites(age_exposure(agt->age) * agt->dgp->day_strength * agt->bite_scale * worktonot);
+
+                if(agt->status == 'E' && prev_status == 'S'){
+                    p.pre_indiv.insert(pair<int, Agent*>(agt->aid, agt));
+                }
+            }
+        }
+    });
+}
+
+void Region::part_update_epi(int year, int day, int dt){
+    ScopedPhase timer(PHASE_UPDATE_EPI);
+
+    run_parts(parts, PHASE_UPDATE_EPI, [&](int i){
+        Partition& p = parts[i];
+        p.visits += p.pre_indiv.size() + p.uninf_indiv.size() + p.inf_indiv.size();
+        p.changes = update_status_sets(p.pre_indiv, p.uninf_indiv, p.inf_indiv, year, day, dt);
+    });
+    epi_changes = 0;
+    for(size_t i = 0; i < parts.size(); ++i) epi_changes += parts[i].changes;
+    last_epi_dt = dt;
+}
+
+void Region::part_renew_pop(int dt){
+    ScopedPhase timer(PHASE_RENEW_POP);
+
+    double p_death[N_AGE_GROUPS];
+    for(int a = 0; a < N_AGE_GROUPS; ++a) p_death[a] = 1 - exp(-mortality_rate[a]*dt);
+    run_parts(parts, PHASE_RENEW_POP, [&](int i){
+        Partition& p = parts[i];
+        for(size_t g = 0; g < p.groups.size(); ++g){
+            Group *grp = p.groups[g];
+            p.visits += grp->group_pop.size();
+            for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
+                Agent *agt = k->second;
+                int index = min(15, int(int(agt->age/365)/5));
+                if(random_real() < p_death[index]) p.deaths.push_back(agt);
+                else agt->age += dt;
+            }
+        }
+    });
+    age_clock += dt;
+    ++lane_epoch;
+
+    //the dead leave day populations of other partitions
+    for(size_t i = 0; i < parts.size(); ++i){
+        for(size_t d = 0; d < parts[i].deaths.size(); ++d) remove_agent(parts[i].deaths[d]);
+        parts[i].deaths.clear();
+    }
+}
+
+void Region::part_handle_birth(int dt){
+    ScopedPhase timer(PHASE_HANDLE_BIRTH);
+
+    double p_birth[N_AGE_GROUPS];
+    for(int a = 0; a < N_AGE_GROUPS; ++a) p_birth[a] = 1 - exp(-birth_rate[a]*dt);
+    run_parts(parts, PHASE_HANDLE_BIRTH, [&](int i){
+        Partition& p = parts[i];
+        for(size_t g = 0; g < p.groups.size(); ++g){
+            Group *grp = p.groups[g];
+            p.visits += grp->group_pop.size();
+            p.births[g] = 0;
+            for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
+                Agent *agt = k->second;
+                if(agt->age >= 15*365 && agt->age < 50*365){
+                    if(random_real() < p_birth[int(int(agt->age/365)/5)]) ++p.births[g];
+                }
+            }
+        }
+    });
+
+    //agent IDs in partition order, bite scales still from the partition's stream
+    ++lane_epoch;
+    for(size_t i = 0; i < parts.size(); ++i){
+        Partition& p = parts[i];
+        RngStream *stream = cur_stream;
+        cur_stream = &p.stream;
+        for(size_t g = 0; g < p.groups.size(); ++g){
+            Group *grp = p.groups[g];
+            for(; p.births[g] > 0; --p.births[g]){
+                Agent *bby = new Agent(next_aid++, agg_param, 0);
+                bby->ngp = grp;
+                bby->dgp = grp;
+                grp->add_member(bby);
+                grp->day_population.insert(pair<int, Agent*>(bby->aid, bby));
+            }
+        }
+        cur_stream = stream;
+    }
+}
+
+void Region::part_mda(int year, MDAStrat strat){
+    ScopedPhase timer(PHASE_MDA);
+
+    int n_pop = 0;
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j) n_pop += j->second->population();
+
+    run_parts(parts, PHASE_MDA, [&](int i){
+        Partition& p = parts[i];
+        p.under_min = 0;
+        for(size_t g = 0; g < p.groups.size(); ++g){
+            Group *grp = p.groups[g];
+            p.visits += grp->group_pop.size();
+            for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
+                if(k->second->age/365.0 < strat.min_age) ++p.under_min;
+            }
+        }
+    });
+    int n_under_min = 0;
+    for(size_t i = 0; i < parts.size(); ++i) n_under_min += parts[i].under_min;
+    double target_prop = 1 - n_under_min /(double)n_pop;
+
+    run_parts(parts, PHASE_MDA, [&](int i){
+        Partition& p = parts[i];
+        p.treated = 0;
+        for(size_t g = 0; g < p.groups.size(); ++g){
+            Group *grp = p.groups[g];
+            p.visits += grp->group_pop.size();
+            for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
+                if(k->second->age/365.0 >= strat.min_age && random_real() <= strat.coverage/(double)target_prop){
+                    ++p.treated;
+                    k->second->mda(strat.drug);
+                }
+            }
+        }
+    });
+    int n_treated = 0;
+    for(size_t i = 0; i < parts.size(); ++i) n_treated += parts[i].treated;
+
+    number_treated[year] = n_treated;
+    achieved_coverage[year] = n_treated/(double)n_pop;
+}
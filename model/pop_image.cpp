@@ -0,0 +1,183 @@
+#include <cstdint>
+#include <cstring>
+
+#include "network.h"
+#include "store.h"
+#include "table.h"
+
+using namespace std;
+
+// The built population is saved as one binary image, <config>/<rname>-<key>.pop:
+//
+//   PopImageHeader
+//   PopImageGroup   x n_groups         (people of a group are contiguous)
+//   group names                        (concatenated, padded to 8 bytes)
+//   double bite_scale[rpop]
+//   int32  aid[rpop]
+//   int32  age[rpop]                   (days)
+//
+// The key is a hash of the inputs the population is built from (store.h), so
+// each scale has its own image.
+
+constexpr char POP_IMAGE_MAGIC[8] = "NETFPOP";
+constexpr uint32_t POP_IMAGE_VERSION = 1;
+
+struct PopImageHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t n_groups;
+    uint64_t key;                       //Region::pop_key of the inputs
+    int32_t rpop, next_aid, next_gid, group_blocks;
+    uint64_t names_bytes;
+};
+
+struct PopImageGroup{
+    int32_t gid;
+    int32_t first;                      //index of the group's first person
+    int32_t count;
+    int32_t name_len;
+    double lon, lat;
+};
+
+static size_t pad8(size_t n){ return (n + 7) & ~(size_t)7; }
+
+//groups.csv, the age distribution and how ages are drawn from it
+uint64_t Region::pop_key(){
+    int32_t shape[2] = {N_AGE_GROUPS, WIDTH_AGE_GROUPS};
+    return hash_bytes(shape, sizeof(shape), hash_files({scale_dir + GROUP_DATA, data_dir + AGE_BRACKETS}));
+}
+
+void Region::save_population(){
+    vector<PopImageGroup> grp_recs;
+    string names;
+    vector<double> bites;
+    vector<int32_t> aids, ages;
+    bites.reserve(rpop);    aids.reserve(rpop);     ages.reserve(rpop);
+
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        Group *grp = j->second;
+        const string& name = group_numbers[grp->gid];
+        grp_recs.push_back({grp->gid, (int32_t)aids.size(), (int32_t)grp->group_pop.size(), (int32_t)name.size(), grp->lon, grp->lat});
+        names += name;
+
+        for(map<int, Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
+            Agent *agt = k->second;
+            bites.push_back(agt->bite_scale);
+            aids.push_back(agt->aid);
+            ages.push_back(agt->age);
+        }
+    }
+    names.resize(pad8(names.size()), '\0');
+
+    PopImageHeader head;
+    memcpy(head.magic, POP_IMAGE_MAGIC, sizeof(head.magic));
+    head.version = POP_IMAGE_VERSION;
+    head.n_groups = grp_recs.size();
+    head.key = pop_key();
+    head.rpop = aids.size();
+    head.next_aid = next_aid;
+    head.next_gid = next_gid;
+    head.group_blocks = group_blocks;
+    head.names_bytes = names.size();
+
+    vector<pair<const void*, size_t>> blocks {{&head, sizeof(head)}, {grp_recs.data(), grp_recs.size()*sizeof(PopImageGroup)},
+                                              {names.data(), names.size()}, {bites.data(), bites.size()*sizeof(double)},
+                                              {aids.data(), aids.size()*sizeof(int32_t)}, {ages.data(), ages.size()*sizeof(int32_t)}};
+    shared_ptr<vector<char>> image = make_shared<vector<char>>();
+    for(const pair<const void*, size_t>& b : blocks) image->insert(image->end(), (const char*)b.first, (const char*)b.first + b.second);
+
+    //replicates reload from the copy in memory, so the first can start while the image goes to disk
+    wait_for_image();
+    built_image = image;
+    string file = store_path(config_dir, rname, head.key, ".pop");
+    image_written = async(launch::async, [file, image]{
+        store_write(file, {{image->data(), image->size()}});
+    });
+}
+
+void Region::wait_for_image(){
+    if(image_written.valid()) image_written.get();
+}
+
+bool Region::pop_reload(bool redraw_bites){
+
+    //checking if we have already generated the input!
+    uint64_t key = pop_key();
+    string file = store_path(config_dir, rname, key, ".pop");
+    //the image built earlier in this run may still be on its way to disk, so take it from memory
+    if(built_image && ((const PopImageHeader*)built_image->data())->key == key)
+        return pop_parse(built_image->data(), built_image->size(), key, file, redraw_bites);
+
+    MappedFile img(file);
+    if(!img.ok()) return false;
+    return pop_parse(img.data(), img.size(), key, file, redraw_bites);
+}
+
+bool Region::pop_parse(const char *data, size_t size, uint64_t key, const string& file, bool redraw_bites){
+    const PopImageHeader *head = (const PopImageHeader*)data;
+    if(size < sizeof(PopImageHeader) || memcmp(head->magic, POP_IMAGE_MAGIC, sizeof(head->magic)) != 0
+       || head->version != POP_IMAGE_VERSION){
+        cout << file << " is not a population image of this version, rebuilding" << endl;
+        return false;
+    }
+    if(head->key != key){
+        cout << file << " was built from other inputs, rebuilding" << endl;
+        return false;
+    }
+    if(head->rpop < 0 || head->n_groups > size / sizeof(PopImageGroup) || head->names_bytes > size){
+        cout << file << " is truncated, rebuilding" << endl;
+        return false;
+    }
+    size_t n = head->rpop;
+    size_t groups_at = sizeof(PopImageHeader);
+    size_t names_at = groups_at + head->n_groups*sizeof(PopImageGroup);
+    size_t bites_at = names_at + head->names_bytes;
+    size_t aids_at = bites_at + n*sizeof(double);
+    size_t ages_at = aids_at + n*sizeof(int32_t);
+    if(size != ages_at + n*sizeof(int32_t)){
+        cout << file << " is truncated, rebuilding" << endl;
+        return false;
+    }
+
+    //a stale or corrupt image must not send us outside it
+    const PopImageGroup *grp_recs = (const PopImageGroup*)(data + groups_at);
+    uint64_t name_total = 0;
+    for(uint32_t g = 0; g < head->n_groups; ++g){
+        const PopImageGroup& rec = grp_recs[g];
+        name_total += (uint32_t)rec.name_len;
+        if(rec.first < 0 || rec.count < 0 || rec.name_len < 0 || (int64_t)rec.first + rec.count > head->rpop
+           || name_total > head->names_bytes){
+            cout << file << " has a bad group record, rebuilding" << endl;
+            return false;
+        }
+    }
+
+    rpop = head->rpop;
+    next_aid = head->next_aid;
+    next_gid = head->next_gid;
+    group_blocks = head->group_blocks;
+
+    const char *names = data + names_at;
+    const double *bites = (const double*)(data + bites_at);
+    const int32_t *aids = (const int32_t*)(data + aids_at);
+    const int32_t *ages = (const int32_t*)(data + ages_at);
+
+    for(uint32_t g = 0; g < head->n_groups; ++g){
+        const PopImageGroup& rec = grp_recs[g];
+        string grp(names, rec.name_len);
+        names += rec.name_len;
+
+        Group *group = new Group(rec.gid, this, rec.lat, rec.lon);
+        group_names.insert(pair<string, int>(grp, rec.gid));
+        group_numbers.insert(pair<int, string>(rec.gid, grp));
+        groups.insert(pair<int, Group*>(rec.gid, group));
+
+        //every replicate draws its own bite scales, the saved ones restore the population as built
+        for(int i = rec.first; i < rec.first + rec.count; ++i){
+            Agent *agt = redraw_bites ? new Agent(aids[i], agg_param, ages[i]) : new Agent(aids[i], ages[i], bites[i]);
+            group->add_member(agt);
+        }
+    }
+
+    return true;
+}
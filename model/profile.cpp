@@ -0,0 +1,179 @@
+#include "profile.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+Profile prof;
+bool profiling = false;
+thread_local constinit ProfileCounters *prof_counters = &prof.counters;
+
+const char *phase_names[N_PHASES] = {
+    "build_population",
+    "seed_lf",
+    "calc_risk",
+    "update_epi_status",
+    "renew_pop",
+    "handle_birth",
+    "handle_commute",
+    "radt_model",
+    "implement_mda",
+    "reset_population",
+    "output_epidemics",
+    "fast_forward"
+};
+
+//hardware counters, opened once on first use (only if PROFILE_PERF_EVENTS)
+static int fd_cycles = -1;
+static int fd_misses = -1;
+static bool perf_tried = false;
+
+#ifdef __linux__
+static int open_counter(uint64_t config){
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0); //this process, any cpu
+}
+#endif
+
+bool perf_events_available(){
+    if constexpr (!PROFILE_PERF_EVENTS) return false;
+
+    if(!perf_tried){
+        perf_tried = true;
+#ifdef __linux__
+        fd_cycles = open_counter(PERF_COUNT_HW_CPU_CYCLES);
+        fd_misses = open_counter(PERF_COUNT_HW_CACHE_MISSES);
+#endif
+        if(fd_cycles < 0 || fd_misses < 0){
+            cout << "Warning: perf_event_open failed, hardware counters disabled (check perf_event_paranoid)" << endl;
+        }
+    }
+    return fd_cycles >= 0 && fd_misses >= 0;
+}
+
+static uint64_t read_counter(int fd){
+    uint64_t value = 0;
+#ifdef __linux__
+    if(read(fd, &value, sizeof(value)) != sizeof(value)) value = 0;
+#endif
+    return value;
+}
+
+ScopedPhase::ScopedPhase(ProfilePhase p): p(p), start_cycles(0), start_misses(0){
+    if(!profiling) return;
+
+    if(perf_events_available()){
+        start_cycles = read_counter(fd_cycles);
+        start_misses = read_counter(fd_misses);
+    }
+    start = chrono::steady_clock::now();
+}
+
+ScopedPhase::~ScopedPhase(){
+    if(!profiling) return;
+
+    PhaseStats &stats = prof.phase[p];
+    stats.ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    ++stats.calls;
+
+    if(perf_events_available()){
+        stats.cycles += read_counter(fd_cycles) - start_cycles;
+        stats.cache_misses += read_counter(fd_misses) - start_misses;
+    }
+}
+
+void Profile::reset(const string& lbl){
+    label = lbl;
+    replicates = 0;
+    for(int i = 0; i < N_PHASES; ++i) phase[i] = PhaseStats();
+    counters = ProfileCounters();
+}
+
+void Profile::write_table(ostream& out) const{
+    bool hw = perf_events_available();
+
+    out << label << " (" << replicates << " replicates)" << endl;
+    out << left << setw(20) << "Phase" << right
+        << setw(10) << "Calls"
+        << setw(14) << "Total (s)"
+        << setw(14) << "Mean (ms)"
+        << setw(16) << "Agents visited";
+    if(hw) out << setw(16) << "Cycles" << setw(16) << "Cache misses";
+    out << endl;
+
+    for(int i = 0; i < N_PHASES; ++i){
+        const PhaseStats &s = phase[i];
+        if(s.calls == 0) continue;
+
+        out << left << setw(20) << phase_names[i] << right
+            << setw(10) << s.calls
+            << setw(14) << fixed << setprecision(3) << s.ns * 1e-9
+            << setw(14) << fixed << setprecision(3) << s.ns * 1e-6 / s.calls
+            << setw(16) << s.agents;
+        if(hw) out << setw(16) << s.cycles << setw(16) << s.cache_misses;
+        out << endl;
+    }
+    out << "Bites drawn: " << counters.bites << endl;
+    out << "Worms created: " << counters.worms_created << endl;
+    out << "Worms destroyed: " << counters.worms_destroyed << endl;
+    out << "Seeding attempts: " << counters.seed_attempts << endl;
+    out.unsetf(ios::floatfield);
+}
+
+void Profile::write_json(ostream& out) const{
+    out << "{\"label\": \"" << label << "\", \"replicates\": " << replicates << ", \"phases\": {";
+
+    bool first = true;
+    for(int i = 0; i < N_PHASES; ++i){
+        const PhaseStats &s = phase[i];
+        if(!first) out << ", ";
+        first = false;
+        out << "\"" << phase_names[i] << "\": {"
+            << "\"calls\": " << s.calls
+            << ", \"seconds\": " << setprecision(9) << s.ns * 1e-9
+            << ", \"agents_visited\": " << s.agents
+            << ", \"cycles\": " << s.cycles
+            << ", \"cache_misses\": " << s.cache_misses << "}";
+    }
+    out << "}, \"counters\": {"
+        << "\"bites\": " << counters.bites
+        << ", \"worms_created\": " << counters.worms_created
+        << ", \"worms_destroyed\": " << counters.worms_destroyed
+        << ", \"seed_attempts\": " << counters.seed_attempts << "}}";
+}
+
+void write_profile_json(const string& filename, const Profile& setup, const vector<Profile>& scenarios){
+    ofstream out(filename);
+    if(!out){
+        cerr << "Could not open " << filename << " to write profile";
+        return;
+    }
+
+    out << "{\n\"hardware_counters\": " << (perf_events_available() ? "true" : "false") << ",\n";
+    out << "\"setup\": ";
+    setup.write_json(out);
+    out << ",\n\"scenarios\": [\n";
+    for(size_t i = 0; i < scenarios.size(); ++i){
+        scenarios[i].write_json(out);
+        if(i + 1 < scenarios.size()) out << ",";
+        out << "\n";
+    }
+    out << "]\n}\n";
+    out.close();
+}
@@ -0,0 +1,83 @@
+#ifndef profile_h
+#define profile_h
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "params.h"
+
+using namespace std;
+
+//phases of a run that we time (nested phases are inclusive, e.g. radt_model sits inside handle_commute)
+enum ProfilePhase{
+    PHASE_BUILD_POP,        //first time population build / reload in Region constructor
+    PHASE_SEED_LF,          //every seeding attempt (including retries)
+    PHASE_CALC_RISK,
+    PHASE_UPDATE_EPI,
+    PHASE_RENEW_POP,
+    PHASE_HANDLE_BIRTH,
+    PHASE_HANDLE_COMMUTE,
+    PHASE_RADT_MODEL,
+    PHASE_MDA,
+    PHASE_RESET_POP,
+    PHASE_OUTPUT,
+    PHASE_FAST_FORWARD,     //cohort demography after elimination (includes its output rows)
+    N_PHASES
+};
+
+extern const char *phase_names[N_PHASES];
+
+struct PhaseStats{
+    uint64_t calls = 0;         //number of times phase was entered
+    uint64_t ns = 0;            //wall clock time (nanoseconds)
+    uint64_t agents = 0;        //agents visited
+    uint64_t cycles = 0;        //cpu cycles (only if PROFILE_PERF_EVENTS)
+    uint64_t cache_misses = 0;  //cache misses (only if PROFILE_PERF_EVENTS)
+};
+
+struct ProfileCounters{
+    uint64_t bites = 0;           //infective bites drawn
+    uint64_t worms_created = 0;
+    uint64_t worms_destroyed = 0;
+    uint64_t seed_attempts = 0;   //calls to seed_lf
+};
+
+class Profile{
+public:
+    string label;                  //e.g. "Scenario 1"
+    int replicates = 0;
+    PhaseStats phase[N_PHASES];
+    ProfileCounters counters;
+
+    void reset(const string& lbl);
+    void write_table(ostream& out) const;  //human readable, for the .netfil PROFILE section
+    void write_json(ostream& out) const;
+};
+
+extern Profile prof; //profile currently being accumulated
+extern bool profiling; //--profile: time each phase and count bites/worms (written to PROFILE section of .netfil)
+extern thread_local constinit ProfileCounters *prof_counters; //this thread's: prof.counters, or a Region partition's while they step in parallel
+
+//times the enclosing scope and adds it to the current profile
+class ScopedPhase{
+public:
+    ScopedPhase(ProfilePhase p);
+    ~ScopedPhase();
+
+private:
+    ProfilePhase p;
+    chrono::steady_clock::time_point start;
+    uint64_t start_cycles, start_misses;
+};
+
+inline void profile_visit(ProfilePhase p, uint64_t n){
+    if(profiling) prof.phase[p].agents += n;
+}
+
+bool perf_events_available();
+void write_profile_json(const string& filename, const Profile& setup, const vector<Profile>& scenarios);
+
+#endif /* profile_h */
@@ -1,43 +1,220 @@
 #include "params.h"
 #include "rng.h"
+#include <float.h>
+#include <limits>
+#include <math.h>
 
 using namespace std;
 
+//Samplers tuned to the model's draws: uniforms come from a buffer filled in bulk,
+//bite counts are Poisson with small means, worm periods are normal and bite scales
+//gamma with shape well below 1. Constructing a std distribution per call was the
+//main cost (check them with bench/samplers).
+
+//32 random bits per uniform, offset by half a step so it is never 0 or 1
+void fill_uniform(double *out, int n){
+    mt19937& eng = cur_stream->eng;
+    uint32_t raw[256];
+    for(int done = 0; done < n; done += 256){
+        int m = min(256, n - done);
+        for(int i = 0; i < m; ++i) raw[i] = eng();
+        for(int i = 0; i < m; ++i) out[done + i] = (raw[i] + 0.5) * 0x1p-32; //vectorised
+    }
+}
+
 double random_real(){
-    uniform_real_distribution<> distribution(0.0,1.0);
+    RngStream *s = cur_stream;
+    if(s->n_uniform == 0){
+        fill_uniform(s->uniform_buf, 256);
+        s->n_uniform = 256;
+    }
+    return s->uniform_buf[--s->n_uniform];
+}
+
+//Ziggurat for standard normals (Marsaglia and Tsang 2000, 128 layers). The layer comes from
+//the low 7 bits and the value from the other 25, so they are independent.
+static uint32_t zig_k[128];
+static double zig_w[128], zig_f[128];
+
+static bool zig_setup(){
+    const double m = 16777216.0; //2^24, magnitude of the value bits
+    const double r = 3.442619855899, v = 9.91256303526217e-3;
+    double dn = r, tn = r;
+    double q = v / exp(-0.5*dn*dn);
+
+    zig_k[0] = (uint32_t)((dn/q)*m);
+    zig_k[1] = 0;
+    zig_w[0] = q/m;
+    zig_w[127] = dn/m;
+    zig_f[0] = 1.0;
+    zig_f[127] = exp(-0.5*dn*dn);
+    for(int i = 126; i >= 1; --i){
+        dn = sqrt(-2*log(v/dn + exp(-0.5*dn*dn)));
+        zig_k[i+1] = (uint32_t)((dn/tn)*m);
+        tn = dn;
+        zig_f[i] = exp(-0.5*dn*dn);
+        zig_w[i] = dn/m;
+    }
+    return true;
+}
+[[maybe_unused]] static bool zig_ready = zig_setup();
+
+//bits() gives 32 random bits and unif() a uniform in (0, 1)
+template <typename Bits, typename Unif>
+static double zig_normal(Bits&& next_bits, Unif&& unif){
+    const double r = 3.442619855899;
+    while(true){
+        uint32_t bits = next_bits();
+        int i = bits & 127;
+        int32_t hz = (int32_t)bits >> 7;
+        uint32_t mag = hz < 0 ? -(int64_t)hz : hz;
+        double x = hz * zig_w[i];
+        if(mag < zig_k[i]) return x; //inside the layer's rectangle, nearly always
+
+        if(i == 0){ //the tail beyond r
+            double xt, y;
+            do{
+                xt = -log(unif()) / r;
+                y = -log(unif());
+            } while(y + y < xt*xt);
+            return hz > 0 ? r + xt : -r - xt;
+        }
+        if(zig_f[i] + unif()*(zig_f[i-1] - zig_f[i]) < exp(-0.5*x*x)) return x;
+    }
+}
+
+static double std_normal(){
+    mt19937& eng = cur_stream->eng;
+    return zig_normal([&eng]{ return (uint32_t)eng(); }, random_real);
+}
+
+//Marsaglia and Tsang (2000), shapes below 1 boosted with a uniform power
+template <typename Bits, typename Unif>
+static double mt_gamma(double shape, Bits&& next_bits, Unif&& unif){
+    if(shape < 1) return mt_gamma(shape + 1, next_bits, unif) * exp(log(unif()) / shape);
+
+    double d = shape - 1.0/3, c = 1/sqrt(9*d);
+    while(true){
+        double x, v;
+        do{
+            x = zig_normal(next_bits, unif);
+            v = 1 + c*x;
+        } while(v <= 0);
+        v = v*v*v;
+        double u = unif();
+        if(u < 1 - 0.0331*x*x*x*x) return d*v;
+        if(log(u) < 0.5*x*x + d*(1 - v + log(v))) return d*v;
+    }
+}
+
+static double std_gamma(double shape){
+    mt19937& eng = cur_stream->eng;
+    return mt_gamma(shape, [&eng]{ return (uint32_t)eng(); }, random_real);
+}
+
+//the same samplers on a stream of one's own (rng.h)
+double stream_uniform(mt19937_64& eng){
+    return ((eng() >> 11) + 0.5) * 0x1p-53;
+}
 
-    return distribution(gen);
+double stream_gamma(double shape, double scale, mt19937_64& eng){
+    return scale*mt_gamma(shape, [&eng]{ return (uint32_t)(eng() >> 32); }, [&eng]{ return stream_uniform(eng); });
 }
 
+//inversion for the small means of bites, std beyond that
 int poisson(double rate){
-    poisson_distribution<int> distribution(rate);
+    if(rate <= 0) return 0;
+    if(rate > 12){
+        poisson_distribution<int> distribution(rate);
+        return distribution(cur_stream->eng);
+    }
+    double u = random_real();
+    //nearly every bite draw is 0, and exp(-rate) >= 1 - rate settles those without exp
+    //(the margin covers rounding of both sides, so the draws are exactly as before)
+    if(u <= 1 - rate - 0x1p-50) return 0;
+    double p = exp(-rate);
+    double cum = p;
+    int k = 0;
+    while(u > cum && p > cum*DBL_EPSILON){ //later terms cannot move cum
+        ++k;
+        p *= rate / k;
+        cum += p;
+    }
+    return k;
+}
 
-    return distribution(gen);
+void reset_samplers(){
+    main_stream.n_uniform = 0;
 }
 
-double normal(double mean, double stddev){
-    normal_distribution<double> distribution(mean, stddev);
+int binomial(int n, double p){
+    binomial_distribution<int> distribution(n, p);
 
-    return distribution(gen);
+    return distribution(cur_stream->eng);
 }
 
-double bite_gamma(double shape, double scale){
-    gamma_distribution<double> distribution(shape, scale);
+//poisson conditioned on at least one event, by inversion from 1
+int poisson_positive(double rate){
+    double u = random_real() * -expm1(-rate);
+    double p = rate * exp(-rate);
+    double cum = p;
+    int k = 1;
+    while(u > cum && p > cum*DBL_EPSILON){
+        ++k;
+        p *= rate / k;
+        cum += p;
+    }
+    return k;
+}
+
+static double event_gap(double log_q){
+    double u = random_real();
+    if(u <= 0) return numeric_limits<double>::infinity();
+    return floor(log(u) / log_q);
+}
+
+EventSkipper::EventSkipper(double p){
+    log_q = log1p(-p); //log(1 - p) would round to 0 for tiny p
+    next = log_q < 0 ? event_gap(log_q) : numeric_limits<double>::infinity();
+
+    seen = 0;
+}
 
-    return distribution(gen);
+int EventSkipper::events(int n){
+    int count = 0;
+    while(next < seen + n){
+        ++count;
+        next += 1 + event_gap(log_q);
+    }
+    seen += n;
+    return count;
+}
+
+void EventSkipper::positions(int n, vector<int>& at){
+    at.clear();
+    while(next < seen + n){
+        at.push_back(int(next - seen));
+        next += 1 + event_gap(log_q);
+    }
+    seen += n;
+}
+
+double normal(double mean, double stddev){
+    return mean + stddev*std_normal();
+}
+
+double bite_gamma(double shape, double scale){
+    return scale*std_gamma(shape);
 }
 
 double init_beta(double a, double b){
     
-    gamma_distribution<> X(a, 1.0);
-    gamma_distribution<> Y(b, 1.0);
-
-    double x = X(gen);
-    double y = Y(gen);
+    double x = std_gamma(a);
+    double y = std_gamma(b);
 
     return  x / (x + y);
 }
 
 void partial_shuffle(vector<double>& vec, int start, int end){
-   shuffle(vec.begin() + start, vec.begin() + end, gen);
+   shuffle(vec.begin() + start, vec.begin() + end, cur_stream->eng);
 }
\ No newline at end of file
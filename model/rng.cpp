@@ -1,7 +1,12 @@
 #include "rng.h"
+#include <algorithm>
 #include <chrono>
 unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-std::mt19937 gen(seed); // Seed the generator
+RngStream main_stream(seed); // Seed the generator
+std::mt19937& gen = main_stream.eng;
+thread_local constinit RngStream *cur_stream = &main_stream;
+
+uint64_t base_seed = seed;
 
 // Warm up the generator
 void warmup() {
@@ -11,4 +16,97 @@ void warmup() {
     }
 }
 
-int dummy = (warmup(), 0);
\ No newline at end of file
+int dummy = (warmup(), 0);
+
+void seed_rng(unsigned s){
+    gen.seed(s);
+    warmup();
+    reset_samplers();
+}
+
+static uint64_t splitmix64(uint64_t z){
+    z += 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+bool crn = false;
+static RngStream purpose_streams[N_STREAM_PURPOSES];
+static uint64_t replicate_key = 0;
+
+void seed_replicate(int scenario, int rep){
+    if(crn) scenario = 0;
+    uint64_t z = splitmix64(base_seed ^ splitmix64(((uint64_t)scenario << 32) | (uint32_t)rep));
+    seed_seq seq {(uint32_t)z, (uint32_t)(z >> 32)};
+    gen.seed(seq);
+    reset_samplers();
+    replicate_key = z;
+    if(crn){
+        for(int p = 0; p < N_STREAM_PURPOSES; ++p) seed_stream(purpose_streams[p], z, p);
+    }
+}
+
+void seed_branch(uint64_t branch){
+    uint64_t z = splitmix64(base_seed ^ splitmix64(branch));
+    seed_seq seq {(uint32_t)z, (uint32_t)(z >> 32)};
+    gen.seed(seq);
+    reset_samplers();
+    for(int p = 0; p < N_STREAM_PURPOSES; ++p) seed_stream(purpose_streams[p], z, p);
+    replicate_key = z; //so clones resync to streams of their own
+}
+
+void resync_stream(StreamPurpose p, uint64_t period){
+    seed_stream(purpose_streams[p], splitmix64(replicate_key ^ splitmix64(period)), p);
+}
+
+//partitions (STEP_PARTITIONS) select their own streams inside, which are kept
+PurposeStream::PurposeStream(StreamPurpose p) : prev(cur_stream){
+    if(crn && cur_stream == &main_stream) cur_stream = &purpose_streams[p];
+}
+
+AliasTable::AliasTable(const vector<double>& weights){
+    int n = weights.size();
+    double total = 0;
+    for(double w : weights) total += w;
+    prob.assign(n, 1.0);
+    alias.resize(n);
+    for(int i = 0; i < n; ++i) alias[i] = i;
+
+    //scaled so the average column is 1, columns under 1 are topped up from one over 1
+    vector<double> scaled(n);
+    vector<int> small, large;
+    for(int i = 0; i < n; ++i){
+        scaled[i] = weights[i]*n/total;
+        (scaled[i] < 1 ? small : large).push_back(i);
+    }
+    while(!small.empty() && !large.empty()){
+        int s = small.back(), l = large.back();
+        small.pop_back();
+        prob[s] = scaled[s];
+        alias[s] = l;
+        scaled[l] -= 1 - scaled[s];
+        if(scaled[l] < 1){
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+}
+
+int AliasTable::draw(double u) const{
+    double x = u*prob.size();
+    int i = min((int)x, (int)prob.size() - 1);
+    return x - i < prob[i] ? i : alias[i];
+}
+
+void seed_stream(mt19937_64& eng, uint64_t key, uint64_t item){
+    //one seed word is enough once mixed, and much cheaper than seed_seq for thousands of groups
+    eng.seed(splitmix64(key ^ splitmix64(item)));
+}
+
+void seed_stream(RngStream& s, uint64_t key, uint64_t item){
+    uint64_t z = splitmix64(key ^ splitmix64(item));
+    seed_seq seq {(uint32_t)z, (uint32_t)(z >> 32)};
+    s.eng.seed(seq);
+    s.n_uniform = 0;
+}
@@ -1,8 +1,56 @@
 #ifndef RANDOM_GEN_H
 #define RANDOM_GEN_H
+#include <cstdint>
 #include <random>
+#include <vector>
 using namespace std;
 
-extern mt19937 gen; // Declaration of the generator
+// the samplers (random_real, normal, bite_gamma, ...) draw from the calling thread's stream: the
+// run's generator and its buffered uniforms, unless the thread has selected one of its own
+struct RngStream{
+    mt19937 eng;
+    double uniform_buf[256];
+    int n_uniform = 0;
+
+    RngStream(unsigned s = mt19937::default_seed) : eng(s) {}
+};
+extern RngStream main_stream;
+extern thread_local constinit RngStream *cur_stream;
+extern mt19937& gen; // the run's generator (main_stream)
+
+void seed_rng(unsigned s); // Reseed (and warm up) the generator, e.g. for reproducible runs
+void reset_samplers(); // drop buffered draws, so a reseed fixes everything that follows
+
+extern uint64_t base_seed; // seed of the whole run (clock by default, --seed to fix it)
+void seed_replicate(int scenario, int rep); // deterministic stream for one replicate, whatever process runs it
+void seed_branch(uint64_t branch);          // reseed a replicate's streams for one clone of it (splitting.cpp)
+
+// Common random numbers (--crn): replicate i of every scenario is seeded alike, and demography,
+// bites and MDA each draw from their own stream, so a scenario that treats differently keeps the
+// other draws in step and scenarios differ only because of the strategy. The population, seeding
+// and output sampling stay on the replicate's main stream.
+enum StreamPurpose{ STREAM_DEMOGRAPHY, STREAM_BITES, STREAM_MDA, N_STREAM_PURPOSES };
+extern bool crn;
+void resync_stream(StreamPurpose p, uint64_t period); // restart a purpose's stream for a period of the replicate, so runs that drew differently line up again
+class PurposeStream{ // selects the purpose's stream for a scope (with --crn, on the main stream)
+public:
+    PurposeStream(StreamPurpose p);
+    ~PurposeStream(){ cur_stream = prev; }
+private:
+    RngStream *prev;
+};
+void seed_stream(mt19937_64& eng, uint64_t key, uint64_t item); // own stream for one item of parallel work (e.g. a group)
+double stream_uniform(mt19937_64& eng);                          // uniform in (0, 1) from such a stream
+double stream_gamma(double shape, double scale, mt19937_64& eng); // gamma, as bite_gamma
+void seed_stream(RngStream& s, uint64_t key, uint64_t item);     // for the samplers, e.g. a Region partition's
+
+// Walker alias table: draw() gives i with probability weights[i]/sum(weights) from one uniform
+struct AliasTable{
+    vector<double> prob;
+    vector<int> alias;
+
+    AliasTable(const vector<double>& weights);
+    int draw(double u) const;   //u uniform in [0, 1)
+};
 
 #endif // RANDOM_GEN_H
\ No newline at end of file
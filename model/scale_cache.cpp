@@ -0,0 +1,180 @@
+#include <cstdint>
+#include <cstring>
+
+#include "kdtree.h"
+#include "network.h"
+#include "parallel.h"
+#include "store.h"
+#include "table.h"
+
+using namespace std;
+
+// Binary copies of what a scale's groups and distance files reduce to, kept in
+// the config directory by input hash (store.h):
+//
+//   dist-<key>.bin      road and euclidean distances (upper triangles)
+//   commute-<key>.bin   every group's destinations, nearest first (radt_model)
+//   near-<key>.bin      only the nearest destinations (SPARSE_COMMUTE): int32
+//                       commute_start[group_blocks+1], then commute_order
+
+constexpr char SCALE_CACHE_MAGIC[8] = "NETFSCL";
+constexpr uint32_t SCALE_CACHE_VERSION = 2;     //1 could hold zero distances for scales without distance files
+
+struct ScaleCacheHeader{
+    char magic[8];
+    uint32_t version;
+    int32_t group_blocks;
+    uint64_t key;
+};
+
+//the array after the header, if the file is there and was made from these inputs
+static const char *cached_array(const MappedFile& in, uint64_t key, int group_blocks, size_t bytes){
+    const ScaleCacheHeader *head = (const ScaleCacheHeader*)in.data();
+    if(!in.ok() || in.size() != sizeof(ScaleCacheHeader) + bytes) return nullptr;
+    if(memcmp(head->magic, SCALE_CACHE_MAGIC, sizeof(head->magic)) != 0 || head->version != SCALE_CACHE_VERSION) return nullptr;
+    if(head->key != key || head->group_blocks != group_blocks) return nullptr;
+    return in.data() + sizeof(ScaleCacheHeader);
+}
+
+static ScaleCacheHeader cache_header(uint64_t key, int group_blocks){
+    ScaleCacheHeader head;
+    memcpy(head.magic, SCALE_CACHE_MAGIC, sizeof(head.magic));
+    head.version = SCALE_CACHE_VERSION;
+    head.group_blocks = group_blocks;
+    head.key = key;
+    return head;
+}
+
+void Region::load_distances(){
+    int len = group_blocks*(group_blocks-1)/2;
+    road_dst = new double[len];     memset(road_dst, 0, sizeof(double)*len);
+    euclid_dst = new double[len];   memset(euclid_dst, 0, sizeof(double)*len);
+
+    dist_key = hash_files({scale_dir + GROUP_DATA, scale_dir + CAR_DISTANCE, scale_dir + CROW_DISTANCE});
+    string file = store_path(config_dir, "dist", dist_key);
+    {
+        MappedFile in(file);
+        const char *cached = cached_array(in, dist_key, group_blocks, 2*sizeof(double)*len);
+        if(cached != nullptr){
+            memcpy(road_dst, cached, sizeof(double)*len);
+            memcpy(euclid_dst, cached + sizeof(double)*len, sizeof(double)*len);
+            return;
+        }
+    }
+
+    cout << "BUILDING ROADS" <<endl;
+
+    //some scales (e.g. rasters) only have euclidean distances
+    bool have_road = read_distances(scale_dir + CAR_DISTANCE, road_dst);
+    bool have_crow = read_distances(scale_dir + CROW_DISTANCE, euclid_dst);
+
+    if(!have_crow){
+        cout << "No " << CROW_DISTANCE << " for this scale, using distances between group coordinates" << endl;
+        coord_distances(euclid_dst);
+    }
+    if(!have_road){
+        cout << "No " << CAR_DISTANCE << " for this scale, using euclidean distances" << endl;
+        memcpy(road_dst, euclid_dst, sizeof(double)*len);
+    }
+
+    ScaleCacheHeader head = cache_header(dist_key, group_blocks);
+    store_write(file, {{&head, sizeof(head)}, {road_dst, sizeof(double)*len}, {euclid_dst, sizeof(double)*len}});
+}
+
+void Region::load_commute_order(char m){
+    commute_type = m;
+    if(SPARSE_COMMUTE){
+        nearest_commute_order();
+        return;
+    }
+
+    // Reading road_dst & euclid_dst for multigroup sims, once the groups are built
+    if(road_dst == nullptr) load_distances();
+
+    int n = group_blocks - 1;
+    commute_order.assign((size_t)group_blocks*n, 0);
+
+    commute_start.resize(group_blocks + 1);
+    for(int g = 0; g <= group_blocks; ++g) commute_start[g] = g*n;
+
+    uint64_t key = hash_bytes(&m, 1, dist_key);
+    string file = store_path(config_dir, "commute", key);
+    {
+        MappedFile in(file);
+        const char *cached = cached_array(in, key, group_blocks, sizeof(int32_t)*commute_order.size());
+        if(cached != nullptr){
+            memcpy(commute_order.data(), cached, sizeof(int32_t)*commute_order.size());
+            return;
+        }
+    }
+
+    double *d = m == 'r' ? road_dst : euclid_dst;
+    vector<int> gids;
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j) gids.push_back(j->first);
+
+    parallel_for(gids.size(), BUILD_THREADS, [&](int j){
+        int src_id = gids[j];
+        vector<pair<double, int>> near;
+        for(int dst_id : gids){
+            if(dst_id == src_id) continue; //same group!
+
+            //finding dist index!
+            int index = (min(src_id, dst_id)-1)*(group_blocks*2-min(src_id, dst_id))/2 + abs(dst_id-src_id) - 1;
+            near.push_back(pair<double, int>(d[index], dst_id));
+        }
+        //ties stay in group order
+        stable_sort(near.begin(), near.end(), [](const pair<double, int>& p, const pair<double, int>& q){ return p.first < q.first; });
+        for(int k = 0; k < n; ++k) commute_order[(size_t)(src_id-1)*n + k] = near[k].second;
+    });
+
+    ScaleCacheHeader head = cache_header(key, group_blocks);
+    store_write(file, {{&head, sizeof(head)}, {commute_order.data(), sizeof(int32_t)*commute_order.size()}});
+}
+
+void Region::nearest_commute_order(){
+    //coordinates come from groups.csv, and the cutoffs decide which are kept
+    uint64_t key = hash_files({scale_dir + GROUP_DATA});
+    key = hash_bytes(&COMMUTE_K, sizeof(COMMUTE_K), key);
+    key = hash_bytes(&COMMUTE_CUTOFF, sizeof(COMMUTE_CUTOFF), key);
+    string file = store_path(config_dir, "near", key);
+    size_t start_bytes = sizeof(int32_t)*(group_blocks + 1);
+    {
+        MappedFile in(file);
+        const char *cached = in.size() >= sizeof(ScaleCacheHeader) + start_bytes ? cached_array(in, key, group_blocks, in.size() - sizeof(ScaleCacheHeader)) : nullptr;
+        if(cached != nullptr){
+            const int32_t *start = (const int32_t*)cached;
+            if(in.size() == sizeof(ScaleCacheHeader) + start_bytes + sizeof(int32_t)*start[group_blocks]){
+                commute_start.assign(start, start + group_blocks + 1);
+                commute_order.assign(start + group_blocks + 1, start + group_blocks + 1 + start[group_blocks]);
+                return;
+            }
+        }
+    }
+
+    cout << "FINDING NEAREST GROUPS" << endl;
+    if(commute_type == 'r') cout << "Sparse commuting has no road distances, using distances between group coordinates" << endl;
+
+    vector<double> x(group_blocks), y(group_blocks);
+    for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
+        x[j->first-1] = j->second->lat;
+        y[j->first-1] = j->second->lon;
+    }
+    KDTree tree(x, y);
+
+    vector<vector<int>> near(group_blocks);
+    parallel_for(group_blocks, BUILD_THREADS, [&](int g){
+        vector<pair<double, int>> found;
+        tree.nearest(x[g], y[g], COMMUTE_K, COMMUTE_CUTOFF, g, found);
+        for(pair<double, int>& p : found) near[g].push_back(p.second + 1);
+    });
+
+    commute_start.assign(group_blocks + 1, 0);
+    for(int g = 0; g < group_blocks; ++g) commute_start[g+1] = commute_start[g] + near[g].size();
+    commute_order.clear();
+    commute_order.reserve(commute_start[group_blocks]);
+    for(int g = 0; g < group_blocks; ++g) commute_order.insert(commute_order.end(), near[g].begin(), near[g].end());
+
+    ScaleCacheHeader head = cache_header(key, group_blocks);
+    store_write(file, {{&head, sizeof(head)}, {commute_start.data(), start_bytes}, {commute_order.data(), sizeof(int32_t)*commute_order.size()}});
+}
+
@@ -15,8 +15,7 @@ done
 [[ " ${VALID_T2[*]} " =~ " $T2 " ]]        || { echo "Invalid -t2: $T2 (options: ${VALID_T2[*]})";        exit 1; }
 [[ " ${VALID_SCALES[*]} " =~ " $SCALE " ]] || { echo "Invalid -scale: $SCALE (options: ${VALID_SCALES[*]})"; exit 1; }
 
-echo "Cleaning and moving files"
-./clean_inputs.sh
+echo "Moving files"
 
 cp ../data/Scales/$SCALE/* ../data/
 cp ../data/Fitted/$SCALE/Theta_$T2/TranParams.csv ../data/
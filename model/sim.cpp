@@ -12,46 +12,64 @@ void Region::sim(int year, MDAStrat strat){
 
     //if the first year, must seed LF in the population
     if(year == 0){
-        init_prev = 0;
-        init_ratio  = 0;
-        // Keep seeding until prev and ratio within bounds
-        while(((init_prev < INIT_PREV_MIN) || (init_prev > INIT_PREV_MAX)) || ((init_ratio < INIT_RATIO_MIN) || (init_ratio > INIT_RATIO_MAX))){
-            seed_lf();
-        }
+        seed_initial_infection();
         
         cout << "Init prev: " << init_prev << "%" << endl;
         cout << "MF to Ant: " << init_ratio << endl;
         
+        if(STEP_PARTITIONS > 0) split_partitions();
     }
 
     if (prv_out_loc == "print"){
         debug_fit = true;
     }
     
+    else if(eliminated){ //no worms left, only the population is projected
+        achieved_coverage[year] = 0;
+        fast_forward(year, 0, strat);
+    }
+
     else{
-        handle_commute(year);
+        {
+            PurposeStream use(STREAM_DEMOGRAPHY);
+            handle_commute(year);
+        }
         achieved_coverage[year] = 0;
 
 
-        int epi_dt = 7; 
         int population_dt = 28;
+        int next_epi_day = 0;
 
         for(int day = 0; day < 364; ++day){
             
-            if (day % epi_dt == 0){
-                if(!(inf_indiv.empty() & pre_indiv.empty() & uninf_indiv.empty())) { //If disease has not been eliminated
-                    
-                    calc_risk();
+            if (mlmc && day % population_dt == 0) resync_stream(STREAM_BITES, year*13 + day/population_dt); //pairs of runs stepped differently (mlmc.cpp) meet again
+            if (day == next_epi_day){
+                int epi_dt = epi_step(year, day, strat);
+                next_epi_day = day + epi_dt;
+
+                if(status_count('E') + status_count('U') + status_count('I') > 0) { //If disease has not been eliminated
+                    PurposeStream use(STREAM_BITES);
+                    calc_risk(epi_dt/(double)EPI_DT);
                     update_epi_status(year, day, epi_dt); //update everyone's LF epi status (including the status of each of their worms)
                 }
+                else if(ELIM_FAST_FORWARD == 'c' || ELIM_FAST_FORWARD == 's'){
+                    start_fast_forward(year, day);
+                    fast_forward(year, day, strat);
+                    return;
+                }
+
             }   
         
             if (day % population_dt == 0){
-                renew_pop(year, day, population_dt); //deaths
-                handle_birth(year, day, population_dt); //births
+                PurposeStream use(STREAM_DEMOGRAPHY);
+                renew_pop(population_dt); //deaths
+                handle_birth(population_dt); //births
+                if(HYBRID_POP) compact_population(year, day); //people without worms or antigen back into pools
+
             }
 
             if((strat.is_mda_year(year+START_YEAR)) && (day == 28)){
+                PurposeStream use(STREAM_MDA);
                 implement_mda(year,strat);
             } 
         
@@ -63,16 +81,46 @@ void Region::sim(int year, MDAStrat strat){
     }
 }
 
+//Tau-leaping style step control: the step is as long as possible while the expected
+//number of status changes (infective bites plus last step's transitions per day) stays
+//below epi_tol of the people with worms. Steps end on output and MDA days as the fixed
+//step does, and are shortest for EPI_MDA_DAYS after a round.
+int Region::epi_step(int year, int day, MDAStrat& strat){
+    if(epi_tol <= 0 && fixed_dt == EPI_DT) return EPI_DT;
+
+    bool mda_year = strat.is_mda_year(year+START_YEAR);
+    int mda_day = 28;
+    int dt;
+    if(epi_tol <= 0) dt = fixed_dt; //a coarse step still ends on output and MDA days
+    else if(mda_year && day >= mda_day && day < mda_day + EPI_MDA_DAYS) dt = EPI_DT_MIN;
+    else{
+        double n_worms = status_count('E') + status_count('U') + status_count('I');
+        double rate = expected_bites/EPI_DT + epi_changes/(double)last_epi_dt; //per day
+        double tau = rate > 0 ? epi_tol*max(n_worms, 1.0)/rate : EPI_DT; //nothing to go on yet
+        dt = max(EPI_DT_MIN, min(EPI_DT_MAX, (int)tau));
+    }
+
+    int stop = (day/91 + 1)*91; //output days
+    if(mda_year && day < mda_day) stop = min(stop, mda_day);
+    return min(dt, min(stop, 364) - day);
+}
+
+void Region::seed_initial_infection(){
+    init_prev = 0;
+    init_ratio  = 0;
+    // Keep seeding until prev and ratio within bounds
+    while(((init_prev < INIT_PREV_MIN) || (init_prev > INIT_PREV_MAX)) || ((init_ratio < INIT_RATIO_MIN) || (init_ratio > INIT_RATIO_MAX))){
+        seed_lf();
+    }
+}
+
 void Region::seed_lf(){
+    ScopedPhase timer(PHASE_SEED_LF);
+    if(profiling) ++prof.counters.seed_attempts;
+
     reset_prev();
     double ant_pos = 0;
 
-    string filename = DATADIR;
-    filename  = filename + "initaggs.csv";
-    ifstream file(filename);
-    string line;
-    vector<double> init_prev_table, init_k_table;
-
     double minDifference = 1;
     int closestIndex = -1;
 
@@ -80,16 +128,7 @@ void Region::seed_lf(){
     double in_agg; //inverse init agg used in calcs oftern
     double mean_load; //mean worm burden in group
 
-    while (getline(file, line)) {
-        stringstream ss(line);
-        string valueA, valueB;
-        getline(ss, valueA, ',');
-        getline(ss, valueB, ',');
-        init_prev_table.push_back(stod(valueA));
-        init_k_table.push_back(stod(valueB));
-    }
     vector<double> bite_scales {};
-    file.close();
     for (int i = 0; i < init_prev_table.size(); ++i) { //now given the prev we are finding the init aggregation from values we have calculated previously (finding the roots here was too intensive so I found them previously in mathematica and included them here)
         double difference = abs(init_prev_table[i] - ANT_0);
         if (difference < minDifference) {
@@ -108,6 +147,7 @@ void Region::seed_lf(){
         
         double group_prev; //antigen prev in our group
         Group *grp = j->second;
+        profile_visit(PHASE_SEED_LF, grp->group_pop.size());
 
         if (groups.size() > 1){ //for multiple groups we need to determine antigen prev which is clustered at the group level
             double group_effect = normal(0.0,SIGMA_G);
@@ -264,6 +304,7 @@ void Region::seed_lf(){
         }
 
     }
+    ++lane_epoch; //bite scales have moved
 }
 
 void Region::prob_worms(double agg_param_init, double worm_mean){
@@ -0,0 +1,141 @@
+#include "campaign.h"
+#include "rng.h"
+#include "store.h"
+#include <algorithm>
+#include <math.h>
+#include <sstream>
+#include <limits>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+extern int sim_i;
+extern string out_path;
+
+// Multilevel splitting (--split) for small probabilities, e.g. of resurgence once MDA stops.
+// The event is the region's m.f. prevalence being at least the last level at the end of the
+// run. From the year after a scenario's last MDA round, a trajectory whose prevalence first
+// reaches one of the lower levels is split into --split-factor clones, each carrying 1/factor
+// of its weight and its own streams from then on. A clone is the process forked at the
+// crossing, so it continues from the whole state of the model. Clones run one at a time,
+// depth first, and add their weight to their root's tally if they end in the event. The
+// roots (NumSims of the scenario) are independent, so the mean of their tallies is an
+// unbiased estimate of the probability and their spread gives its standard error.
+
+struct SplitTally{
+    double hit = 0;     //weight of the root's clones that ended in the event
+    double years = 0;   //years simulated by the root and its clones
+    int clones = 0;
+};
+
+//one root replicate, split at its crossings, in this process and its clones
+static void run_root(Region *rgn, MDAStrat& strategy, int monitor_from, const vector<double>& levels, int factor,
+                     SplitTally& tally){
+    double weight = 1;
+    uint64_t branch = hash_bytes(&sim_i, sizeof(sim_i)); //sim_i is the root's, in every clone
+    int level = 0;
+    bool clone = false;
+
+    for(int year = 0; year < SIM_YEARS; ++year){
+        rgn->sim(year, strategy);
+        ++tally.years;
+        if(year < monitor_from) continue;
+
+        double prev = mf_prevalence(rgn);
+        while(level + 1 < (int)levels.size() && prev >= levels[level]){
+            ++level;
+            weight /= factor;
+            int c = 0;
+            for(int k = 1; k < factor; ++k){
+                cout.flush();
+                pid_t pid = fork();
+                if(pid == 0){
+                    c = k;
+                    clone = true;
+                    break;
+                }
+                int status;
+                waitpid(pid, &status, 0);
+                if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+                    cout << "Splitting clone " << pid << " failed" << endl;
+                    exit(1);
+                }
+            }
+            //every copy, this one too, goes on with streams of its own
+            int key[2] = {level, c};
+            branch = hash_bytes(key, sizeof(key), branch);
+            seed_branch(branch);
+            for(size_t i = 0; i < rgn->parts.size(); ++i) seed_stream(rgn->parts[i].stream, branch, i);
+            if(c > 0) ++tally.clones;
+        }
+    }
+    if(mf_prevalence(rgn) >= levels.back()) tally.hit += weight;
+    if(clone){
+        cout.flush();
+        _exit(0);
+    }
+}
+
+int run_splitting(Region *rgn, const string& out_file, const string& mda_data, const vector<double>& levels, int factor){
+    if(levels.empty() || !is_sorted(levels.begin(), levels.end()) || factor < 2){
+        cout << "--split needs increasing prevalence levels and --split-factor at least 2" << endl;
+        return 1;
+    }
+    rgn->wait_for_image(); //no threads across fork
+    string split_file = out_file + ".split.csv";
+    string rows = out_path;
+    out_path.clear();      //clones would repeat their root's rows (out_file may be out_path)
+
+    vector<Shard> shards = plan_shards(mda_data, numeric_limits<int>::max());
+    ofstream out(split_file);
+    out << "scenario,roots,clones,probability,se,replicates_equivalent,brute_force_replicates" << endl;
+
+    for(const Shard& shard : shards){
+        MDAStrat strategy = get_mda_strat(mda_data, shard.scenario + 1);
+        int monitor_from = 0;
+        for(int year = 0; year < SIM_YEARS; ++year) if(strategy.is_mda_year(year + START_YEAR)) monitor_from = year + 1;
+
+        int n = shard.rep_last - shard.rep_first;
+        //clones are other processes, so the tallies are shared
+        SplitTally *tallies = (SplitTally*)mmap(nullptr, sizeof(SplitTally)*n, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if(tallies == MAP_FAILED){
+            cout << "mmap failed" << endl;
+            return 1;
+        }
+        for(int i = 0; i < n; ++i) tallies[i] = SplitTally();
+
+        for(int i = 0; i < n; ++i){
+            sim_i = shard.sim_offset + shard.rep_first + i;
+            seed_replicate(shard.scenario, shard.rep_first + i);
+            rgn->replicate = shard.rep_first + i;
+            rgn->reset_population();
+            run_root(rgn, strategy, monitor_from, levels, factor, tallies[i]);
+            ++prof.replicates;
+        }
+
+        double sum = 0, sum_sq = 0, years = 0;
+        int clones = 0;
+        for(int i = 0; i < n; ++i){
+            sum += tallies[i].hit;
+            sum_sq += tallies[i].hit*tallies[i].hit;
+            years += tallies[i].years;
+            clones += tallies[i].clones;
+        }
+        munmap(tallies, sizeof(SplitTally)*n);
+
+        double p = sum/n;
+        double se = n > 1 ? sqrt(max(0.0, (sum_sq - sum*sum/n)/(n - 1))/n) : 0;
+        double equivalent = years/SIM_YEARS;                     //cost in whole replicates
+        double brute = se > 0 ? p*(1 - p)/(se*se) : 0;           //plain replicates for the same standard error
+        out << shard.scenario + 1 << "," << n << "," << clones << "," << p << "," << se << "," << equivalent << "," << brute << endl;
+        cout << "Scenario " << shard.scenario + 1 << ": P(m.f. prevalence >= " << levels.back() << " in the final year) = "
+             << p << " (se " << se << ") for the cost of " << equivalent << " replicates";
+        if(brute > 0) cout << ", plain Monte Carlo needs about " << brute;
+        cout << endl;
+    }
+    out_path = rows;
+    return 0;
+}
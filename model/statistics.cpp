@@ -2,11 +2,13 @@
 #include "rng.h"
 #include <cstring>
 
-extern string prv_out_loc;
+extern string out_path;
 extern int sim_i;
 
 void Region::output_epidemics(int year, int day, MDAStrat strategy){
-    
+    if(out_path.empty()) return; //no rows, e.g. while splitting (splitting.cpp)
+    ScopedPhase timer(PHASE_OUTPUT);
+
     //total pop
     double pop_total = 0;
     double inf_total = 0;
@@ -34,7 +36,8 @@ void Region::output_epidemics(int year, int day, MDAStrat strategy){
 
     for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){ //going through groups
         Group *grp = j->second;
-        pop_total += grp->group_pop.size();
+        pop_total += grp->population();
+        profile_visit(PHASE_OUTPUT, grp->group_pop.size());
 
         //now over people
         for(map<int,Agent*>::iterator k = grp->group_pop.begin(); k != grp->group_pop.end(); ++k){
@@ -67,15 +70,22 @@ void Region::output_epidemics(int year, int day, MDAStrat strategy){
         }
 
     }
+    for(size_t i = 0; i < lingering.size(); ++i){ //after elimination only these can still be antigen positive
+        if(random_real() < pow(DAILY_PROB_LOSE_ANT, (year*365 +day) - lingering[i].last_mworm_time)){
+            ++antigen_pos_groups[lingering[i].grp->gid - 1];
+            ++ant_total;
+        }
+    }
     if (day == 0){
     cout << endl;
     
-    cout << year+START_YEAR << ": " << "prepatent = " << pre_indiv.size() << " uninfectious = " << uninf_indiv.size() << " infectious = " << inf_indiv.size() << " antigen positive = " << ant_total << endl;
-    cout << "overall mf prevalence = " << fixed << setprecision(2) << inf_indiv.size()/(double)rpop*100 << "%" << endl;
+    cout << year+START_YEAR << ": " << "prepatent = " << status_count('E') << " uninfectious = " << status_count('U') << " infectious = " << status_count('I') << " antigen positive = " << ant_total << endl;
+    cout << "overall mf prevalence = " << fixed << setprecision(2) << status_count('I')/(double)rpop*100 << "%" << endl;
     cout<< "overall ant prevalence = " << fixed << setprecision(2) << ant_total/(double)rpop*100 << "%" << endl;
     cout<< "overall ratio prevalence = " << fixed << setprecision(2) << ant_total/inf_total << endl;
     }
-    string prv_dat = OUTDIR;    prv_dat = prv_dat + prv_out_loc; 
+    string prv_dat = out_path;
+
     ofstream out;   ifstream in;
     in.open(prv_dat.c_str()); // try opening the target for output
     if(!in){ // if it doesn't exist write a heading
@@ -167,14 +177,15 @@ void Region::output_epidemics(int year, int day, MDAStrat strategy){
     out << nine_mated_adult << ",";
     out << tenplus_mated_adult<< ",";
     for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
-        double n_village = (j -> second -> group_pop).size();
+        double n_village = j -> second -> population();
         if(n_village==0) out << "NA,"; // there's a chance that populations in small villages might drop to zero - this is to avoid crashes in that situation
         else out << n_village << ",";
     }
     for(map<int, Group*>::iterator j = groups.begin(); j != groups.end(); ++j){
-        double n_village = (j -> second -> group_pop).size();
+        double n_village = j -> second -> population();
         if(n_village==0) out << "NA,"; // there's a chance that populations in small villages might drop to zero - this is to avoid crashes in that situation
         else out <<  inf_groups[j -> first - 1] << ",";
+
     }
     out << endl;
     out.close();
@@ -0,0 +1,49 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+#include "store.h"
+#include "table.h"
+
+using namespace std;
+
+uint64_t hash_bytes(const void *p, size_t n, uint64_t h){
+    const unsigned char *b = (const unsigned char*)p;
+    for(size_t i = 0; i < n; ++i){
+        h ^= b[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+uint64_t hash_files(const vector<string>& files, uint64_t h){
+    for(const string& file : files){
+        MappedFile in(file);
+        char state = in.ok() ? '+' : '-';
+        h = hash_bytes(&state, 1, h);
+        h = hash_bytes(in.data(), in.size(), h);
+    }
+    return h;
+}
+
+string store_path(const string& dir, const string& kind, uint64_t key, const string& ext){
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+    return dir + kind + "-" + hex + ext;
+}
+
+void store_write(const string& path, const vector<pair<const void*, size_t>>& blocks){
+    filesystem::path p(path);
+    if(p.has_parent_path()) filesystem::create_directories(p.parent_path());
+
+    string tmp = path + ".tmp" + to_string(getpid());
+    ofstream out(tmp.c_str(), ios::binary);
+    for(const pair<const void*, size_t>& b : blocks) out.write((const char*)b.first, b.second);
+    out.close();
+    if(!out){
+        cout << "writing " << tmp << " failed" << endl;
+        exit(1);
+    }
+    filesystem::rename(tmp, path);
+}
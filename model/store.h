@@ -0,0 +1,25 @@
+#ifndef store_h
+#define store_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Preprocessed artefacts (population image, binary distances, commuting order)
+// are kept in the config directory under names that carry a hash of the inputs
+// they were made from, e.g. $config/dist-3f9c0a71d2e4b856.bin. Runs on different
+// scales or parameter sets can share the directory, and each finds its own.
+
+constexpr uint64_t HASH_START = 14695981039346656037ull;
+
+uint64_t hash_bytes(const void *p, size_t n, uint64_t h = HASH_START);     //FNV-1a
+uint64_t hash_files(const vector<string>& files, uint64_t h = HASH_START);  //contents, a missing file hashes as absent
+
+string store_path(const string& dir, const string& kind, uint64_t key, const string& ext = ".bin");
+
+//writes the blocks to a temporary file and renames it, so concurrent runs never read half a file
+void store_write(const string& path, const vector<pair<const void*, size_t>>& blocks);
+
+#endif /* store_h */
@@ -0,0 +1,362 @@
+#include "campaign.h"
+#include "rng.h"
+#include "table.h"
+#include <array>
+#include <cstring>
+#include <math.h>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+extern int sim_i;
+extern string out_path;
+
+// Parameter sweeps (--sweep SPEC) and Sobol sensitivity indices. SPEC is a CSV of name, low
+// and high, one row per parameter: a TranParams column (Theta_1, Theta_2, Agg, WorktoNot) or
+// an inline constant of params.h. --design lhs is a Latin hypercube of --points points,
+// sobol the first --points of a Sobol sequence, and saltelli (the default) --points base rows
+// of matrices A and B from a Sobol sequence of twice the dimension, run as A, B and A with
+// each column from B, N*(d+2) points in all. Every point runs NumSims replicates of scenario 1
+// of the MDA file, seeded alike at every point, so points differ by their parameters only.
+// Forked workers (--sweep-workers, all cores by default) share the loaded scale and take
+// points as they go, appending each to <out>.sweep.csv when it is done. A saltelli sweep then
+// writes first order (Saltelli 2010) and total (Jansen) indices of every output, with
+// bootstrap intervals over the base rows, to <out>.sobol.csv.
+
+struct InlineConstant{
+    const char *name;
+    double *value;
+};
+
+static const InlineConstant inline_constants[] = {
+    {"IMMATURE_PERIOD_MEAN", &IMMATURE_PERIOD_MEAN}, {"IMMATURE_PERIOD_MEAN_STD", &IMMATURE_PERIOD_MEAN_STD},
+    {"MATURE_PERIOD_MEAN", &MATURE_PERIOD_MEAN}, {"MATURE_PERIOD_MEAN_STD", &MATURE_PERIOD_MEAN_STD},
+    {"PROPORTION_MALE_WORM", &PROPORTION_MALE_WORM}, {"PROPORTION_MALE_AGENT", &PROPORTION_MALE_AGENT},
+    {"INIT_PREV_MIN", &INIT_PREV_MIN}, {"INIT_PREV_MAX", &INIT_PREV_MAX},
+    {"INIT_RATIO_MIN", &INIT_RATIO_MIN}, {"INIT_RATIO_MAX", &INIT_RATIO_MAX},
+    {"ANT_0", &ANT_0}, {"SIGMA_G", &SIGMA_G}, {"BETA_0", &BETA_0},
+    {"COMMUTING_PROP", &COMMUTING_PROP}, {"DAILY_PROB_LOSE_ANT", &DAILY_PROB_LOSE_ANT},
+};
+
+bool Region::set_parameter(const string& name, double value){
+    if(name == "Theta_1" || name == "Theta_2" || name == "Agg" || name == "WorktoNot") tran_overrides[name] = value;
+    if(name == "Theta_1") theta1 = value;
+    else if(name == "Theta_2"){
+        theta2 = value;
+        theta3 = 1 / (1 - exp(-theta2));
+    }
+    else if(name == "Agg"){
+        agg_param = value;  //bite scales are redrawn with it every replicate
+        agg_scale = 1 / value;
+    }
+    else if(name == "WorktoNot") worktonot = value;
+    else if(name == "COMMUTING_PROP" && DEMOG_REPLAYS > 0) return false; //replayed commuting was drawn with the old one
+    else{
+        for(const InlineConstant& c : inline_constants){
+            if(name != c.name) continue;
+            *c.value = value;
+            return true;
+        }
+        return false;
+    }
+    return true;
+}
+
+static void print_parameter_names(){
+    cout << "Parameters are Theta_1, Theta_2, Agg, WorktoNot";
+    for(const InlineConstant& c : inline_constants){
+        if(string(c.name) != "COMMUTING_PROP" || DEMOG_REPLAYS == 0) cout << ", " << c.name;
+    }
+    cout << endl;
+}
+
+bool apply_settings(Region *rgn, const string& settings){
+    stringstream ss(settings);
+    string item;
+    while(getline(ss, item, ',')){
+        if(item.empty()) continue;
+        size_t eq = item.find('=');
+        if(eq == string::npos || !rgn->set_parameter(item.substr(0, eq), atof(item.substr(eq + 1).c_str()))){
+            cout << "Cannot set " << item << endl;
+            print_parameter_names();
+            return false;
+        }
+        rgn->settings += (rgn->settings.empty() ? "" : ",") + item;
+    }
+    return true;
+}
+
+struct SweepParam{
+    string name;
+    double low, high;
+};
+
+// Sobol sequence with the direction numbers of Joe and Kuo (new-joe-kuo-6.21201): degree s,
+// coefficients a and initial m_1..m_s of dimensions 2 to 40, dimension 1 is van der Corput.
+constexpr int SOBOL_DIMS = 40;
+constexpr int SOBOL_BITS = 32;
+static const int sobol_init[SOBOL_DIMS - 1][10] = {
+    {1, 0, 1}, {2, 1, 1, 3}, {3, 1, 1, 3, 1}, {3, 2, 1, 1, 1}, {4, 1, 1, 1, 3, 3}, {4, 4, 1, 3, 5, 13},
+    {5, 2, 1, 1, 5, 5, 17}, {5, 4, 1, 1, 5, 5, 5}, {5, 7, 1, 1, 7, 11, 19}, {5, 11, 1, 1, 5, 1, 1},
+    {5, 13, 1, 1, 1, 3, 11}, {5, 14, 1, 3, 5, 5, 31}, {6, 1, 1, 3, 3, 9, 7, 49}, {6, 13, 1, 1, 1, 15, 21, 21},
+    {6, 16, 1, 3, 1, 13, 27, 49}, {6, 19, 1, 1, 1, 15, 7, 5}, {6, 22, 1, 3, 1, 15, 13, 25}, {6, 25, 1, 1, 5, 5, 19, 61},
+    {7, 1, 1, 3, 7, 11, 23, 15, 103}, {7, 4, 1, 3, 7, 13, 13, 15, 69}, {7, 7, 1, 1, 3, 13, 7, 35, 63},
+    {7, 8, 1, 3, 5, 9, 1, 25, 53}, {7, 14, 1, 3, 1, 13, 9, 35, 107}, {7, 19, 1, 3, 1, 5, 27, 61, 31},
+    {7, 21, 1, 1, 5, 11, 19, 41, 61}, {7, 28, 1, 3, 5, 3, 3, 13, 69}, {7, 31, 1, 1, 7, 13, 1, 19, 1},
+    {7, 32, 1, 3, 7, 5, 13, 19, 59}, {7, 37, 1, 1, 3, 9, 25, 29, 41}, {7, 41, 1, 3, 5, 13, 23, 1, 55},
+    {7, 42, 1, 3, 7, 3, 13, 59, 17}, {7, 50, 1, 3, 1, 3, 5, 53, 69}, {7, 55, 1, 1, 5, 5, 23, 33, 13},
+    {7, 56, 1, 1, 7, 7, 1, 61, 123}, {7, 59, 1, 1, 7, 9, 13, 61, 49}, {7, 62, 1, 3, 3, 5, 3, 55, 33},
+    {8, 14, 1, 3, 1, 15, 31, 13, 49, 245}, {8, 21, 1, 3, 5, 15, 31, 59, 63, 97}, {8, 22, 1, 3, 1, 11, 11, 11, 77, 249},
+};
+
+//points of the first n dimensions, skipping the all zero first point (Gray code order)
+static vector<vector<double>> sobol_points(int n_points, int dims){
+    vector<array<uint32_t, SOBOL_BITS>> v(dims);
+    for(int k = 0; k < SOBOL_BITS; ++k) v[0][k] = 1u << (SOBOL_BITS - 1 - k);
+    for(int j = 1; j < dims; ++j){
+        const int *init = sobol_init[j - 1];
+        int s = init[0], a = init[1];
+        for(int k = 0; k < s; ++k) v[j][k] = (uint32_t)init[2 + k] << (SOBOL_BITS - 1 - k);
+        for(int k = s; k < SOBOL_BITS; ++k){
+            v[j][k] = v[j][k - s] ^ (v[j][k - s] >> s);
+            for(int i = 1; i < s; ++i) if((a >> (s - 1 - i)) & 1) v[j][k] ^= v[j][k - i];
+        }
+    }
+    vector<vector<double>> points;
+    vector<uint32_t> x(dims, 0);
+    for(uint32_t i = 0; (int)points.size() < n_points; ++i){
+        int c = __builtin_ctz(~i); //rightmost zero bit of i
+        for(int j = 0; j < dims; ++j) x[j] ^= v[j][c];
+        vector<double> p(dims);
+        for(int j = 0; j < dims; ++j) p[j] = x[j] / 4294967296.0;
+        points.push_back(p);
+    }
+    return points;
+}
+
+//rows of the unit hypercube to run
+static vector<vector<double>> make_design(const string& design, int n, int d){
+    vector<vector<double>> rows;
+    if(design == "lhs"){
+        rows.assign(n, vector<double>(d));
+        mt19937_64 eng;
+        for(int p = 0; p < d; ++p){
+            seed_stream(eng, base_seed, p);
+            vector<int> strata(n);
+            for(int i = 0; i < n; ++i) strata[i] = i;
+            for(int i = n - 1; i > 0; --i) swap(strata[i], strata[(int)(stream_uniform(eng)*(i + 1))]);
+            for(int i = 0; i < n; ++i) rows[i][p] = (strata[i] + stream_uniform(eng))/n;
+        }
+    }
+    else if(design == "sobol") rows = sobol_points(n, d);
+    else{
+        for(const vector<double>& ab : sobol_points(n, 2*d)){
+            vector<double> a(ab.begin(), ab.begin() + d), b(ab.begin() + d, ab.end());
+            rows.push_back(a);
+            rows.push_back(b);
+            for(int i = 0; i < d; ++i){
+                vector<double> abi = a;
+                abi[i] = b[i];
+                rows.push_back(abi);
+            }
+        }
+    }
+    return rows;
+}
+
+//the outputs of a point, averaged over its replicates: m.f. prevalence and elimination at the end of each year asked for
+static void run_point(Region *rgn, MDAStrat& strategy, const vector<int>& years, double *out){
+    int n_out = 2*years.size();
+    for(int k = 0; k < n_out; ++k) out[k] = 0;
+    for(int rep = 0; rep < strategy.n_sims; ++rep){
+        sim_i = rep;
+        seed_replicate(0, rep);
+        rgn->replicate = rep;
+        rgn->reset_population();
+        for(int year = 0; year < SIM_YEARS; ++year){
+            rgn->sim(year, strategy);
+            for(size_t k = 0; k < years.size(); ++k){
+                if(years[k] != year + START_YEAR) continue;
+                double prev = mf_prevalence(rgn);
+                out[2*k] += prev/strategy.n_sims;
+                out[2*k + 1] += (prev == 0)/(double)strategy.n_sims;
+            }
+        }
+        ++prof.replicates;
+    }
+}
+
+struct Interval{
+    double est, lo, hi;
+};
+
+//first order and total index of parameter i from the base rows picked
+static void sobol_indices(const vector<double>& f, int d, int n_out, int k, int i, const vector<int>& rows, double& first, double& total){
+    double sum = 0, sum_sq = 0, v_first = 0, v_total = 0;
+    for(int j : rows){
+        double fa = f[(j*(d + 2))*n_out + k], fb = f[(j*(d + 2) + 1)*n_out + k], fab = f[(j*(d + 2) + 2 + i)*n_out + k];
+        sum += fa + fb;
+        sum_sq += fa*fa + fb*fb;
+        v_first += fb*(fab - fa);
+        v_total += (fa - fab)*(fa - fab)/2;
+    }
+    double m = 2.0*rows.size();
+    double var = sum_sq/m - (sum/m)*(sum/m);
+    first = var > 0 ? v_first/rows.size()/var : 0;
+    total = var > 0 ? v_total/rows.size()/var : 0;
+}
+
+static Interval percentile(vector<double>& boot, double est){
+    sort(boot.begin(), boot.end());
+    int n = boot.size();
+    return Interval {est, boot[(int)(0.025*(n - 1))], boot[(int)(0.975*(n - 1))]};
+}
+
+int run_sweep(Region *rgn, const string& out_file, const string& mda_data, const string& spec_file,
+              const string& design, int n_points, int n_workers, const vector<int>& years){
+    if(design != "lhs" && design != "sobol" && design != "saltelli"){
+        cout << "--design is lhs, sobol or saltelli" << endl;
+        return 1;
+    }
+    Table spec(spec_file);
+    int c_name = spec.col("name"), c_low = spec.col("low"), c_high = spec.col("high");
+    vector<SweepParam> params;
+    for(int r = 0; r < spec.rows(); ++r){
+        params.push_back(SweepParam {spec.text(r, c_name), spec.num(r, c_low), spec.num(r, c_high)});
+        if(!rgn->set_parameter(params.back().name, params.back().low)){
+            cout << "Cannot sweep " << params.back().name << endl;
+            print_parameter_names();
+            return 1;
+        }
+    }
+    int d = params.size();
+    if(d == 0 || n_points < 2 || (design != "lhs" && (design == "saltelli" ? 2*d : d) > SOBOL_DIMS)){
+        cout << "--sweep needs parameters (at most " << SOBOL_DIMS/2 << " for saltelli, " << SOBOL_DIMS
+             << " for sobol) and --points of 2 or more" << endl;
+        return 1;
+    }
+    for(int y : years){
+        if(y < START_YEAR || y >= START_YEAR + SIM_YEARS){
+            cout << "--sweep-years must be from " << START_YEAR << " to " << START_YEAR + SIM_YEARS - 1 << endl;
+            return 1;
+        }
+    }
+
+    vector<vector<double>> unit = make_design(design, n_points, d);
+    int n_runs = unit.size(), n_out = 2*years.size();
+    vector<string> out_names;
+    for(int y : years){
+        out_names.push_back("mf_prev_" + to_string(y));
+        out_names.push_back("elim_" + to_string(y));
+    }
+    MDAStrat strategy = get_mda_strat(mda_data, 1);
+    cout << "Sweeping " << d << " parameters over " << n_runs << " points of " << strategy.n_sims << " replicates" << endl;
+
+    //rows are appended by whichever worker ran the point
+    string sweep_file = out_file + ".sweep.csv", sobol_file = out_file + ".sobol.csv";
+    {
+        ofstream head(sweep_file);
+        head << "point";
+        for(const SweepParam& p : params) head << "," << p.name;
+        for(const string& name : out_names) head << "," << name;
+        head << endl;
+    }
+    string rows = out_path;
+    out_path.clear(); //no per-replicate rows (out_file may be out_path)
+
+    //outputs, done flags and the next point, shared by the workers
+    size_t shared_bytes = sizeof(double)*n_runs*n_out + n_runs + sizeof(int);
+    char *shared = (char*)mmap(nullptr, shared_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(shared == MAP_FAILED){
+        cout << "mmap failed" << endl;
+        return 1;
+    }
+    memset(shared, 0, shared_bytes);
+    double *results = (double*)shared;
+    char *done = shared + sizeof(double)*n_runs*n_out;
+    int *next = (int*)(done + n_runs);
+
+    if(n_workers <= 0) n_workers = max(1u, thread::hardware_concurrency());
+    rgn->wait_for_image(); //no threads across fork
+    cout.flush();
+    vector<pid_t> workers;
+    for(int w = 0; w < min(n_workers, n_runs); ++w){
+        pid_t pid = fork();
+        if(pid == 0){
+            int fd = open(sweep_file.c_str(), O_WRONLY | O_APPEND);
+            for(int i; (i = __atomic_fetch_add(next, 1, __ATOMIC_SEQ_CST)) < n_runs;){
+                for(int p = 0; p < d; ++p) rgn->set_parameter(params[p].name, params[p].low + unit[i][p]*(params[p].high - params[p].low));
+                run_point(rgn, strategy, years, results + (size_t)i*n_out);
+                done[i] = 1;
+
+                ostringstream row;
+                row.precision(10);
+                row << i;
+                for(int p = 0; p < d; ++p) row << "," << params[p].low + unit[i][p]*(params[p].high - params[p].low);
+                for(int k = 0; k < n_out; ++k) row << "," << results[(size_t)i*n_out + k];
+                row << "\n";
+                string line = row.str();
+                if(write(fd, line.data(), line.size()) != (ssize_t)line.size()) _exit(1); //one write, so rows never interleave
+            }
+            close(fd);
+            _exit(0);
+        }
+        workers.push_back(pid);
+    }
+    bool failed = false;
+    for(pid_t pid : workers){
+        int status;
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+            cout << "Sweep worker " << pid << " failed" << endl;
+            failed = true;
+        }
+    }
+    for(int i = 0; i < n_runs; ++i) failed = failed || !done[i];
+    vector<double> f(results, results + (size_t)n_runs*n_out);
+    munmap(shared, shared_bytes);
+    out_path = rows;
+    if(failed){
+        cout << "The sweep did not finish, " << sweep_file << " has the points that did" << endl;
+        return 1;
+    }
+    cout << "Wrote " << n_runs << " points to " << sweep_file << endl;
+    if(design != "saltelli") return 0;
+
+    //indices on all base rows, and on SWEEP_BOOTSTRAP resamples of them
+    ofstream out(sobol_file);
+    out << "output,parameter,first_order,first_lo,first_hi,total,total_lo,total_hi" << endl;
+    mt19937_64 eng;
+    seed_stream(eng, base_seed, n_runs);
+    vector<int> all(n_points);
+    for(int j = 0; j < n_points; ++j) all[j] = j;
+    vector<vector<int>> resamples(SWEEP_BOOTSTRAP, vector<int>(n_points));
+    for(vector<int>& r : resamples) for(int& j : r) j = min(n_points - 1, (int)(stream_uniform(eng)*n_points));
+
+    for(int k = 0; k < n_out; ++k){
+        cout << out_names[k] << ":" << endl;
+        for(int i = 0; i < d; ++i){
+            double first, total;
+            sobol_indices(f, d, n_out, k, i, all, first, total);
+            vector<double> boot_first, boot_total;
+            for(const vector<int>& r : resamples){
+                double bf, bt;
+                sobol_indices(f, d, n_out, k, i, r, bf, bt);
+                boot_first.push_back(bf);
+                boot_total.push_back(bt);
+            }
+            Interval s1 = percentile(boot_first, first), st = percentile(boot_total, total);
+            out << out_names[k] << "," << params[i].name << "," << s1.est << "," << s1.lo << "," << s1.hi << ","
+                << st.est << "," << st.lo << "," << st.hi << endl;
+            cout << "  " << params[i].name << ": first order " << s1.est << " (" << s1.lo << " to " << s1.hi
+                 << "), total " << st.est << " (" << st.lo << " to " << st.hi << ")" << endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "table.h"
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static string_view trim(const char *b, const char *e){
+    while(b < e && (*b == ' ' || *b == '\t')) ++b;
+    while(e > b && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) --e;
+    return string_view(b, e - b);
+}
+
+MappedFile::MappedFile(const string& path){
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd >= 0 && fstat(fd, &st) == 0){
+        length = st.st_size;
+        if(length == 0) opened = true;
+        else{
+            void *m = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(m != MAP_FAILED){
+                bytes = (const char*)m;
+                opened = true;
+            }
+        }
+    }
+    if(fd >= 0) close(fd);
+}
+
+MappedFile::~MappedFile(){
+    if(bytes != nullptr) munmap((void*)bytes, length);
+}
+
+Table::Table(const string& path, bool header, char sep, bool required) : path(path), file(path){
+    if(!ok()){
+        if(required){
+            cout << "open " << path << " failed" << endl;
+            exit(1);
+        }
+        row_start.push_back(0);
+        return;
+    }
+
+    const char *p = file.data(), *end = file.data() + file.size();
+    int line = 0;
+    bool need_header = header;
+    while(p < end){
+        const char *eol = (const char*)memchr(p, '\n', end - p);
+        if(eol == nullptr) eol = end;
+        ++line;
+
+        string_view whole = trim(p, eol);
+        if(whole.empty() || whole[0] == '*'){ //blank or a description
+            p = eol + 1;
+            continue;
+        }
+        size_t first = cells.size();
+        const char *b = whole.data(), *e = whole.data() + whole.size();
+        while(true){
+            const char *s = (const char*)memchr(b, sep, e - b);
+            if(s == nullptr) s = e;
+            cells.push_back(trim(b, s));
+            if(s == e) break;
+            b = s + 1;
+        }
+
+        if(need_header){
+            for(size_t i = first; i < cells.size(); ++i) names.push_back(string(cells[i]));
+            cells.resize(first);
+            header_line = line;
+            need_header = false;
+        }
+        else{
+            row_start.push_back(first);
+            row_line.push_back(line);
+        }
+        p = eol + 1;
+    }
+    row_start.push_back(cells.size());
+}
+
+bool Table::has_col(const string& name) const{
+    for(size_t i = 0; i < names.size(); ++i) if(names[i] == name) return true;
+    return false;
+}
+
+int Table::col(const string& name) const{
+    for(size_t i = 0; i < names.size(); ++i) if(names[i] == name) return i;
+    fail(-1, "no column '" + name + "'");
+}
+
+void Table::need_rows(int n) const{
+    if(rows() != n) fail(rows() > 0 ? rows() - 1 : -1, "expected " + to_string(n) + " rows, found " + to_string(rows()));
+}
+
+string_view Table::field(int row, int col) const{
+    if(col >= width(row)){
+        fail(row, "missing column " + (col < (int)names.size() ? "'" + names[col] + "'" : to_string(col + 1)));
+    }
+    return cells[row_start[row] + col];
+}
+
+double Table::num(int row, int col) const{
+    string_view f = field(row, col);
+    double x;
+    from_chars_result r = from_chars(f.data(), f.data() + f.size(), x);
+    if(r.ec != errc() || r.ptr != f.data() + f.size()) fail(row, "'" + string(f) + "' is not a number");
+    return x;
+}
+
+int Table::integer(int row, int col) const{
+    string_view f = field(row, col);
+    int x;
+    from_chars_result r = from_chars(f.data(), f.data() + f.size(), x);
+    if(r.ec != errc() || r.ptr != f.data() + f.size()) fail(row, "'" + string(f) + "' is not a whole number");
+    return x;
+}
+
+void Table::fail(int row, const string& msg) const{
+    cout << path << ":" << (row < 0 ? header_line : row_line[row]) << ": " << msg << endl;
+    exit(1);
+}
@@ -0,0 +1,65 @@
+#ifndef table_h
+#define table_h
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// A read-only memory mapping of a whole file.
+class MappedFile{
+public:
+    MappedFile(const string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return opened; }                  //false if the file could not be opened
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+// Input tables. The file is memory-mapped once and split into fields that point
+// into the mapping, so nothing is copied until a field is converted (with
+// from_chars). Blank lines and lines starting with '*' are skipped. Columns are
+// found by header name, and bad input stops the run with file:line.
+
+class Table{
+public:
+    Table(const string& path, bool header = true, char sep = ',', bool required = true);
+    Table(const Table&) = delete;
+    Table& operator=(const Table&) = delete;
+
+    bool ok() const { return file.ok(); }              //false if the file could not be opened
+    int rows() const { return (int)row_line.size(); }
+    int width(int row) const { return row_start[row+1] - row_start[row]; }
+
+    const vector<string>& header() const { return names; }
+    bool has_col(const string& name) const;
+    int col(const string& name) const;                  //exits if there is no such column
+    void need_rows(int n) const;                        //exits unless there are exactly n rows
+
+    string_view field(int row, int col) const;
+    string text(int row, int col) const { return string(field(row, col)); }
+    double num(int row, int col) const;
+    int integer(int row, int col) const;
+
+    [[noreturn]] void fail(int row, const string& msg) const;   //row -1 for the header
+
+private:
+    string path;
+    MappedFile file;
+    vector<string> names;
+    int header_line = 0;
+    vector<string_view> cells;
+    vector<int> row_start;      //index in cells of each row's first field (and the end)
+    vector<int> row_line;       //line in the file of each row
+};
+
+#endif /* table_h */
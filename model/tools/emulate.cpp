@@ -0,0 +1,129 @@
+// Emulator of the fitting statistics (emulator.h), to screen ABC and sensitivity runs, run from model/:
+//
+//   ./tools/emulate add --state ../output/abc.emu --run ../output/r_1_p0001
+//   ./tools/emulate screen --state ../output/abc.emu --in candidates.csv --out kept.csv --eps 2 [--reps 5]
+//   ./tools/emulate propose --state ../output/abc.emu --n 100 --out proposals.csv --eps 2 [--seed 12]
+//   ./tools/emulate predict --state ../output/abc.emu --in candidates.csv --out predictions.csv
+//   ./tools/emulate report --state ../output/abc.emu
+//
+// add updates the state with a finished run of the model (its output CSV). Candidates are
+// CSVs with columns T1, k and W. screen keeps those whose L1 distance to the targets
+// (--obs-antigen 6.2 and --obs-mf 1.59 by default, --obs-ratio to add Ratio_2014) may be
+// --eps or less, and propose draws them from the uniform priors until --n pass. Both write
+// the emulator's predictions, and count what they reject as simulations saved.
+
+#include "emulator.h"
+#include "../params.h"
+#include "../rng.h"
+#include "../table.h"
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+static void write_header(ofstream& out){
+    out << "T1,k,W";
+    for(int s = 0; s < EMU_STATS; ++s) out << "," << EMU_STAT_NAMES[s] << "," << EMU_STAT_NAMES[s] << "_sd";
+    out << endl;
+}
+
+static void write_row(ofstream& out, const EmuPoint& x, const EmuPrediction& p){
+    out << x[0] << "," << x[1] << "," << x[2];
+    for(int s = 0; s < EMU_STATS; ++s) out << "," << p.mean[s] << "," << p.sd[s];
+    out << endl;
+}
+
+int main(int argc, const char * argv[]){
+    if(argc < 2){
+        cout << "Usage: emulate add|screen|propose|predict|report --state FILE [--run CSV] [--in CSV] [--out CSV] [--eps E] [--n N]" << endl;
+        return 1;
+    }
+    string cmd = argv[1], state, run_file, in_file, out_file;
+    double eps = -1;
+    int reps = 5, n = 0;
+    uint64_t seed = 1;
+    EmuStats obs = {numeric_limits<double>::quiet_NaN(), 6.2, 1.59};
+
+    for(int i = 2; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "--state" && i + 1 < argc) state = argv[++i];
+        else if(arg == "--run" && i + 1 < argc) run_file = argv[++i];
+        else if(arg == "--in" && i + 1 < argc) in_file = argv[++i];
+        else if(arg == "--out" && i + 1 < argc) out_file = argv[++i];
+        else if(arg == "--eps" && i + 1 < argc) eps = atof(argv[++i]);
+        else if(arg == "--reps" && i + 1 < argc) reps = atoi(argv[++i]);
+        else if(arg == "--n" && i + 1 < argc) n = atoi(argv[++i]);
+        else if(arg == "--seed" && i + 1 < argc) seed = stoull(argv[++i]);
+        else if(arg == "--obs-ratio" && i + 1 < argc) obs[0] = atof(argv[++i]);
+        else if(arg == "--obs-antigen" && i + 1 < argc) obs[1] = atof(argv[++i]);
+        else if(arg == "--obs-mf" && i + 1 < argc) obs[2] = atof(argv[++i]);
+        else{
+            cout << "Unknown option: " << arg << endl;
+            return 1;
+        }
+    }
+    if(state.empty()){
+        cout << "emulate needs --state" << endl;
+        return 1;
+    }
+
+    Emulator emu;
+    emu.load(state);
+
+    if(cmd == "add"){
+        EmuRun run;
+        if(!read_run(run_file, run)){
+            cout << "No model output in " << run_file << endl;
+            return 1;
+        }
+        emu.add(run);
+    }
+    else if(cmd == "screen" || cmd == "predict"){
+        if(in_file.empty() || out_file.empty() || (cmd == "screen" && eps < 0)){
+            cout << cmd << " needs --in and --out" << (cmd == "screen" ? " and --eps" : "") << endl;
+            return 1;
+        }
+        Table t(in_file);
+        int c_t1 = t.col("T1"), c_k = t.col("k"), c_w = t.col("W");
+        ofstream out(out_file);
+        out.precision(10);
+        write_header(out);
+        int kept = 0;
+        for(int r = 0; r < t.rows(); ++r){
+            EmuPoint x = {t.num(r, c_t1), t.num(r, c_k), t.num(r, c_w)};
+            if(cmd == "screen" && !emu.plausible(x, reps, obs, eps)) continue;
+            write_row(out, x, emu.predict(x, reps));
+            ++kept;
+        }
+        if(cmd == "screen") cout << "Kept " << kept << " of " << t.rows() << " candidates" << endl;
+    }
+    else if(cmd == "propose"){
+        if(n <= 0 || out_file.empty() || eps < 0){
+            cout << "propose needs --n, --out and --eps" << endl;
+            return 1;
+        }
+        ofstream out(out_file);
+        out.precision(10);
+        write_header(out);
+        mt19937_64 eng;
+        int kept = 0, tries = 0;
+        for(; kept < n && tries < 1000*n; ++tries){
+            seed_stream(eng, seed, emu.counts.drawn++); //later calls go on to new candidates
+            EmuPoint x = {EMU_T1_MAX*stream_uniform(eng), EMU_K_MAX*stream_uniform(eng), EMU_W_MAX*stream_uniform(eng)};
+            if(!emu.plausible(x, reps, obs, eps)) continue;
+            write_row(out, x, emu.predict(x, reps));
+            ++kept;
+        }
+        cout << "Proposed " << kept << " of " << tries << " candidates drawn" << endl;
+    }
+    else if(cmd != "report"){
+        cout << "Unknown command: " << cmd << endl;
+        return 1;
+    }
+
+    if(cmd != "report" && cmd != "predict") emu.save(state);
+    emu.report();
+    return 0;
+}
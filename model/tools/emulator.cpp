@@ -0,0 +1,323 @@
+#include "emulator.h"
+#include "../params.h"
+#include "../rng.h"
+#include "../store.h"
+#include "../table.h"
+
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <math.h>
+
+using namespace std;
+
+const char *EMU_STAT_NAMES[EMU_STATS] = {"Ratio_2014", "Antigen_2016", "MF_2016"};
+
+constexpr char EMU_MAGIC[8] = "NETFEMU";
+constexpr uint32_t EMU_VERSION = 1;
+constexpr uint64_t FEATURE_KEY = 0x454d554c41544f52ull; //the features are the same for every state
+constexpr double VAR_FLOOR = 1e-4;      //added to replicate variances, some are 0 (e.g. no m.f. in any replicate)
+constexpr double NOISE_RIDGE = 1;       //prior precision of the log noise coefficients
+constexpr int RATIO_YEAR = 2014, SURVEY_YEAR = 2016;
+
+struct EmuHeader{
+    char magic[8];
+    uint32_t version;
+    int32_t features;
+    uint64_t key;
+};
+
+static uint64_t settings_key(){
+    double shape[5] = {(double)EMU_FEATURES, EMU_LENGTHSCALE, EMU_T1_MAX, EMU_K_MAX, EMU_W_MAX};
+    return hash_bytes(shape, sizeof(shape));
+}
+
+//the statistics of each replicate (sim_i) at day 0, then their means and variances
+bool read_run(const string& output_csv, EmuRun& run){
+    Table t(output_csv, true, ',', false);
+    if(!t.ok() || t.rows() == 0) return false;
+    int c_sim = t.col("sim_i"), c_year = t.col("year"), c_day = t.col("day"), c_pop = t.col("pop_total"),
+        c_inf = t.col("inf_total"), c_ant = t.col("ant_total");
+    run.x = {t.num(0, t.col("theta1")), t.num(0, t.col("agg_param")), t.num(0, t.col("worktonot"))};
+
+    const double nan = numeric_limits<double>::quiet_NaN();
+    map<int, EmuStats> sims;
+    for(int r = 0; r < t.rows(); ++r){
+        if(t.integer(r, c_day) != 0) continue;
+        int year = t.integer(r, c_year);
+        if(year != RATIO_YEAR && year != SURVEY_YEAR) continue;
+        map<int, EmuStats>::iterator it = sims.find(t.integer(r, c_sim));
+        if(it == sims.end()) it = sims.insert(pair<int, EmuStats>(t.integer(r, c_sim), {nan, nan, nan})).first;
+        double pop = t.num(r, c_pop), inf = t.num(r, c_inf), ant = t.num(r, c_ant);
+        if(year == RATIO_YEAR && ant > 0) it->second[0] = inf/ant;
+        if(year == SURVEY_YEAR && pop > 0){
+            it->second[1] = ant/pop*100;
+            it->second[2] = inf/pop*100;
+        }
+    }
+    for(int s = 0; s < EMU_STATS; ++s){
+        double n = 0, sum = 0, sum_sq = 0;
+        for(map<int, EmuStats>::iterator it = sims.begin(); it != sims.end(); ++it){
+            if(isnan(it->second[s])) continue;
+            ++n;
+            sum += it->second[s];
+            sum_sq += it->second[s]*it->second[s];
+        }
+        run.reps[s] = (int)n;
+        run.mean[s] = n > 0 ? sum/n : nan;
+        run.var[s] = n > 1 ? max(0.0, (sum_sq - sum*sum/n)/(n - 1)) : nan;
+    }
+    return true;
+}
+
+//lower Cholesky factor of the symmetric positive definite n x n matrix m, in place
+static void cholesky(vector<double>& m, int n){
+    for(int j = 0; j < n; ++j){
+        double s = m[j*n + j];
+        for(int k = 0; k < j; ++k) s -= m[j*n + k]*m[j*n + k];
+        m[j*n + j] = sqrt(max(s, 1e-300));
+        for(int i = j + 1; i < n; ++i){
+            double t = m[i*n + j];
+            for(int k = 0; k < j; ++k) t -= m[i*n + k]*m[j*n + k];
+            m[i*n + j] = t/m[j*n + j];
+        }
+    }
+}
+
+static void solve_lower(const vector<double>& l, int n, vector<double>& x){ //L y = x
+    for(int i = 0; i < n; ++i){
+        double t = x[i];
+        for(int k = 0; k < i; ++k) t -= l[i*n + k]*x[k];
+        x[i] = t/l[i*n + i];
+    }
+}
+
+static void solve_upper(const vector<double>& l, int n, vector<double>& x){ //L' z = x
+    for(int i = n - 1; i >= 0; --i){
+        double t = x[i];
+        for(int k = i + 1; k < n; ++k) t -= l[k*n + i]*x[k];
+        x[i] = t/l[i*n + i];
+    }
+}
+
+static double dot(const vector<double>& a, const vector<double>& b){
+    double s = 0;
+    for(size_t i = 0; i < a.size(); ++i) s += a[i]*b[i];
+    return s;
+}
+
+Emulator::Emulator() : omega(EMU_FEATURES), phase(EMU_FEATURES){
+    //frequencies of the kernel's spectral density, N(0, 1/lengthscale^2) in each scaled parameter
+    mt19937_64 eng;
+    for(int j = 0; j < EMU_FEATURES; ++j){
+        seed_stream(eng, FEATURE_KEY, j);
+        for(int p = 0; p < EMU_PARAMS; ++p){
+            double u1 = stream_uniform(eng), u2 = stream_uniform(eng);
+            omega[j][p] = sqrt(-2*log(u1))*cos(2*M_PI*u2)/EMU_LENGTHSCALE;
+        }
+        phase[j] = 2*M_PI*stream_uniform(eng);
+    }
+    size_t d = EMU_FEATURES;
+    for(StatFit& f : fits){
+        f.a.assign(d*d, 0);
+        f.g.assign(d*d, 0);
+        f.c.assign(d, 0);
+        f.d.assign(d, 0);
+        f.h.assign(d, 0);
+        f.e.assign(d, 0);
+    }
+}
+
+void Emulator::features(const EmuPoint& x, vector<double>& phi) const{
+    const double range[EMU_PARAMS] = {EMU_T1_MAX, EMU_K_MAX, EMU_W_MAX};
+    phi.resize(EMU_FEATURES);
+    for(int j = 0; j < EMU_FEATURES; ++j){
+        double arg = phase[j];
+        for(int p = 0; p < EMU_PARAMS; ++p) arg += omega[j][p]*x[p]/range[p];
+        phi[j] = sqrt(2.0/EMU_FEATURES)*cos(arg);
+    }
+}
+
+void Emulator::refactor() const{
+    if(!dirty) return;
+    int n = EMU_FEATURES;
+    for(int s = 0; s < EMU_STATS; ++s){
+        const StatFit& f = fits[s];
+        Factor& fac = factors[s];
+
+        //weights of the features ~ N(0, var_y) a priori, about the mean of the runs so far
+        fac.mean_y = f.n > 0 ? f.sum_y/f.n : 0;
+        fac.var_y = f.n > 1 ? max((f.sum_y2 - f.sum_y*f.sum_y/f.n)/(f.n - 1), 1e-12) : 1;
+        fac.chol = f.a;
+        for(int j = 0; j < n; ++j) fac.chol[j*n + j] += 1/fac.var_y;
+        cholesky(fac.chol, n);
+        fac.beta.resize(n);
+        for(int j = 0; j < n; ++j) fac.beta[j] = f.c[j] - fac.mean_y*f.d[j];
+        solve_lower(fac.chol, n, fac.beta);
+        solve_upper(fac.chol, n, fac.beta);
+
+        fac.noise_ok = f.nv > 1;
+        if(!fac.noise_ok) continue;
+        fac.mean_logv = f.sum_logv/f.nv;
+        vector<double> g = f.g;
+        for(int j = 0; j < n; ++j) g[j*n + j] += NOISE_RIDGE;
+        cholesky(g, n);
+        fac.gamma.resize(n);
+        for(int j = 0; j < n; ++j) fac.gamma[j] = f.h[j] - fac.mean_logv*f.e[j];
+        solve_lower(g, n, fac.gamma);
+        solve_upper(g, n, fac.gamma);
+    }
+    dirty = false;
+}
+
+double Emulator::noise_var(int s, const vector<double>& phi) const{
+    refactor();
+    const Factor& fac = factors[s];
+    if(!fac.noise_ok) return fac.var_y; //until there are replicate variances, as much as the runs' means vary
+    return exp(fac.mean_logv + dot(phi, fac.gamma));
+}
+
+void Emulator::predict(const vector<double>& phi, int reps, EmuPrediction& p) const{
+    refactor();
+    vector<double> v(phi.size());
+    for(int s = 0; s < EMU_STATS; ++s){
+        const Factor& fac = factors[s];
+        p.mean[s] = fac.mean_y + dot(phi, fac.beta);
+        v = phi;
+        solve_lower(fac.chol, EMU_FEATURES, v);
+        p.sd[s] = sqrt(dot(v, v) + noise_var(s, phi)/max(reps, 1));
+    }
+}
+
+EmuPrediction Emulator::predict(const EmuPoint& x, int reps) const{
+    vector<double> phi;
+    features(x, phi);
+    EmuPrediction p;
+    predict(phi, reps, p);
+    return p;
+}
+
+void Emulator::add(const EmuRun& run){
+    int n = EMU_FEATURES;
+    vector<double> phi;
+    features(run.x, phi);
+
+    //how well the emulator predicted this run before seeing it
+    if(counts.runs >= EMU_MIN_RUNS){
+        for(int s = 0; s < EMU_STATS; ++s){
+            if(run.reps[s] == 0) continue;
+            EmuPrediction p;
+            predict(phi, run.reps[s], p);
+            ++counts.checked;
+            if(fabs(run.mean[s] - p.mean[s]) <= EMU_Z*p.sd[s]) ++counts.covered;
+        }
+    }
+
+    for(int s = 0; s < EMU_STATS; ++s){
+        if(run.reps[s] == 0) continue;
+        StatFit& f = fits[s];
+        double v = run.reps[s] > 1 ? run.var[s] : noise_var(s, phi);
+        double tau = max(v, VAR_FLOOR)/run.reps[s];
+        double y = run.mean[s];
+        for(int i = 0; i < n; ++i){
+            for(int j = 0; j < n; ++j) f.a[i*n + j] += phi[i]*phi[j]/tau;
+            f.c[i] += phi[i]*y/tau;
+            f.d[i] += phi[i]/tau;
+        }
+        ++f.n;
+        f.sum_y += y;
+        f.sum_y2 += y*y;
+
+        if(run.reps[s] > 1){
+            double logv = log(run.var[s] + VAR_FLOOR);
+            for(int i = 0; i < n; ++i){
+                for(int j = 0; j < n; ++j) f.g[i*n + j] += phi[i]*phi[j];
+                f.h[i] += phi[i]*logv;
+                f.e[i] += phi[i];
+            }
+            ++f.nv;
+            f.sum_logv += logv;
+        }
+    }
+    ++counts.runs;
+    dirty = true;
+}
+
+bool Emulator::plausible(const EmuPoint& x, int reps, const EmuStats& obs, double eps){
+    ++counts.screened;
+    if(counts.runs < EMU_MIN_RUNS) return true;
+    EmuPrediction p = predict(x, reps);
+    double gap = 0; //the least distance that is EMU_Z sds from the predictions
+    for(int s = 0; s < EMU_STATS; ++s){
+        if(!isnan(obs[s])) gap += max(0.0, fabs(p.mean[s] - obs[s]) - EMU_Z*p.sd[s]);
+    }
+    if(gap <= eps) return true;
+    ++counts.rejected;
+    return false;
+}
+
+void Emulator::report() const{
+    cout << counts.runs << " runs added, " << counts.screened << " candidates screened, " << counts.rejected
+         << " rejected (simulations saved)";
+    if(counts.screened > 0) cout << ", " << 100.0*counts.rejected/counts.screened << "% of those screened";
+    cout << endl;
+    if(counts.checked > 0){
+        cout << "New runs were inside the predicted " << EMU_Z << " sd interval " << 100.0*counts.covered/counts.checked
+             << "% of the time (" << 100*erf(EMU_Z/sqrt(2.0)) << "% if the emulator is right)" << endl;
+    }
+    for(int s = 0; s < EMU_STATS; ++s){
+        cout << EMU_STAT_NAMES[s] << ": " << fits[s].n << " runs, " << fits[s].nv << " with a replicate variance" << endl;
+    }
+}
+
+//the header and counts, then per statistic its sums in the order of StatFit
+void Emulator::save(const string& path) const{
+    EmuHeader head;
+    memcpy(head.magic, EMU_MAGIC, sizeof(head.magic));
+    head.version = EMU_VERSION;
+    head.features = EMU_FEATURES;
+    head.key = settings_key();
+    vector<array<double, 5>> scalars;
+    for(const StatFit& f : fits) scalars.push_back({f.n, f.sum_y, f.sum_y2, f.nv, f.sum_logv});
+
+    vector<pair<const void*, size_t>> blocks {{&head, sizeof(head)}, {&counts, sizeof(counts)}};
+    for(int s = 0; s < EMU_STATS; ++s){
+        const StatFit& f = fits[s];
+        blocks.push_back({scalars[s].data(), sizeof(scalars[s])});
+        for(const vector<double> *v : {&f.a, &f.c, &f.d, &f.g, &f.h, &f.e}) blocks.push_back({v->data(), v->size()*sizeof(double)});
+    }
+    store_write(path, blocks);
+}
+
+bool Emulator::load(const string& path){
+    MappedFile in(path);
+    if(!in.ok()) return false;
+    size_t d = EMU_FEATURES;
+    size_t per_stat = 5*sizeof(double) + (2*d*d + 4*d)*sizeof(double);
+    const EmuHeader *head = (const EmuHeader*)in.data();
+    if(in.size() != sizeof(EmuHeader) + sizeof(Counts) + EMU_STATS*per_stat || memcmp(head->magic, EMU_MAGIC, sizeof(head->magic)) != 0
+       || head->version != EMU_VERSION || head->key != settings_key()){
+        cout << path << " is not an emulator state with these EMU_ settings (params.h), delete it to start again" << endl;
+        exit(1);
+    }
+    const char *at = in.data() + sizeof(EmuHeader);
+    memcpy(&counts, at, sizeof(counts));
+    at += sizeof(counts);
+    for(StatFit& f : fits){
+        double scalars[5];
+        memcpy(scalars, at, sizeof(scalars));
+        at += sizeof(scalars);
+        f.n = scalars[0];
+        f.sum_y = scalars[1];
+        f.sum_y2 = scalars[2];
+        f.nv = scalars[3];
+        f.sum_logv = scalars[4];
+        for(vector<double> *v : {&f.a, &f.c, &f.d, &f.g, &f.h, &f.e}){
+            memcpy(v->data(), at, v->size()*sizeof(double));
+            at += v->size()*sizeof(double);
+        }
+    }
+    dirty = true;
+    return true;
+}
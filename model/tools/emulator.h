@@ -0,0 +1,80 @@
+#ifndef emulator_h
+#define emulator_h
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Emulator of the fitting statistics (Ratio_2014, Antigen_2016 and MF_2016, as R/abc_raster.R
+// computes them) over theta1, k and worktonot, to screen ABC and sensitivity candidates
+// before they are simulated. Each statistic is a Bayesian linear regression on EMU_FEATURES
+// random Fourier features of the parameters scaled by their prior ranges, which is a Gaussian
+// process with a squared exponential kernel. A run counts by the noise of its replicate mean.
+// That noise is a second regression, of the log variance between replicates, so it may
+// change across the space. The state is sums over the runs, so adding one has a fixed cost.
+
+constexpr int EMU_PARAMS = 3;
+constexpr int EMU_STATS = 3;
+extern const char *EMU_STAT_NAMES[EMU_STATS];
+
+typedef array<double, EMU_PARAMS> EmuPoint;    //theta1, k, worktonot
+typedef array<double, EMU_STATS> EmuStats;     //NaN where a statistic is undefined or not targeted
+
+struct EmuRun{                      //one finished run of the model
+    EmuPoint x;
+    EmuStats mean, var;             //over its replicates
+    array<int, EMU_STATS> reps;     //replicates with the statistic defined
+};
+
+struct EmuPrediction{               //of a run's replicate means
+    EmuStats mean, sd;
+};
+
+bool read_run(const string& output_csv, EmuRun& run); //from the model's output rows
+
+class Emulator{
+public:
+    Emulator();
+    bool load(const string& path);  //false if there is no state yet, exits if it was made with other settings
+    void save(const string& path) const;
+
+    void add(const EmuRun& run);
+    EmuPrediction predict(const EmuPoint& x, int reps) const;
+    bool plausible(const EmuPoint& x, int reps, const EmuStats& obs, double eps); //may the L1 distance be eps or less
+    void report() const;
+
+    struct Counts{
+        int64_t runs = 0;
+        int64_t screened = 0, rejected = 0; //rejected candidates are simulations saved
+        int64_t checked = 0, covered = 0;   //new runs' statistics inside the EMU_Z interval predicted before they were added
+        int64_t drawn = 0;                  //candidates proposed so far
+    } counts;
+
+private:
+    struct StatFit{
+        double n = 0, sum_y = 0, sum_y2 = 0;
+        vector<double> a, c, d;             //sums of phi phi'/tau, phi y/tau and phi/tau (tau: the noise of the run's mean)
+        double nv = 0, sum_logv = 0;
+        vector<double> g, h, e;             //sums of phi phi', phi log(v) and phi over runs with a replicate variance v
+    };
+    struct Factor{                          //of a StatFit, redone after runs are added
+        double mean_y, var_y, mean_logv;
+        vector<double> chol, beta, gamma;   //of the posterior precision, and the mean and log noise coefficients
+        bool noise_ok;
+    };
+    vector<EmuPoint> omega;
+    vector<double> phase;
+    array<StatFit, EMU_STATS> fits;
+    mutable array<Factor, EMU_STATS> factors;
+    mutable bool dirty = true;
+
+    void features(const EmuPoint& x, vector<double>& phi) const;
+    void refactor() const;
+    double noise_var(int s, const vector<double>& phi) const; //of one replicate
+    void predict(const vector<double>& phi, int reps, EmuPrediction& p) const;
+};
+
+#endif /* emulator_h */
@@ -0,0 +1,46 @@
+// Builds a scale from the population raster or the building footprints, run from model/:
+//
+//   ./tools/make_scale --out ../data/Scales/Raster440/ [--source raster|buildings] [--cell 440]
+//                      [--input file] [--population 54359] [--weight count|area] [--no-distances]
+//
+// --cell 0 keeps every raster cell or building as its own group. Without euc_dist.csv the
+// model uses distances between group coordinates; very fine scales want COMMUTE_K (params.h).
+
+#include "scale_builder.h"
+#include "../params.h"
+
+#include <chrono>
+
+using namespace std;
+
+int main(int argc, const char * argv[]){
+    ScaleSpec spec;
+    string out_dir;
+
+    for(int i = 1; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "--out" && i + 1 < argc) out_dir = argv[++i];
+        else if(arg == "--source" && i + 1 < argc) spec.source = argv[++i];
+        else if(arg == "--input" && i + 1 < argc) spec.input = argv[++i];
+        else if(arg == "--cell" && i + 1 < argc) spec.cell = atof(argv[++i]);
+        else if(arg == "--population" && i + 1 < argc) spec.population = atol(argv[++i]);
+        else if(arg == "--weight" && i + 1 < argc) spec.weight = argv[++i];
+        else if(arg == "--no-distances") spec.euclid_file = false;
+        else{
+            cout << "Unknown option: " << arg << endl;
+            return 1;
+        }
+    }
+    if(out_dir.empty()){
+        cout << "Usage: make_scale --out <dir> [--source raster|buildings] [--cell metres] [--population N]" << endl;
+        return 1;
+    }
+    if(out_dir.back() != '/') out_dir += "/";
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int groups = write_binned_scale(spec, out_dir);
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Wrote " << groups << " groups (" << spec.population << " people, " << spec.source << " in "
+         << spec.cell << " m cells) to " << out_dir << " in " << secs << " s" << endl;
+    return 0;
+}
@@ -0,0 +1,45 @@
+// Writes a synthetic scale for stress testing, run from model/:
+//
+//   ./tools/make_synthetic --out ../data/Scales/Synth10k/ --groups 10000 --population 1000000
+//                          [--layout uniform|clustered|grid] [--islands 5] [--extent 50000]
+//                          [--pop-sigma 1.0] [--seed 1] [--no-distances] [--template ../data/]
+//
+// Without distance files the model falls back to distances between group coordinates.
+
+#include "synth.h"
+#include "../params.h"
+
+using namespace std;
+
+int main(int argc, const char * argv[]){
+    SynthSpec spec;
+    string out_dir;
+
+    for(int i = 1; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "--out" && i + 1 < argc) out_dir = argv[++i];
+        else if(arg == "--groups" && i + 1 < argc) spec.groups = atoi(argv[++i]);
+        else if(arg == "--population" && i + 1 < argc) spec.population = atol(argv[++i]);
+        else if(arg == "--layout" && i + 1 < argc) spec.layout = argv[++i];
+        else if(arg == "--islands" && i + 1 < argc) spec.islands = atoi(argv[++i]);
+        else if(arg == "--extent" && i + 1 < argc) spec.extent = atof(argv[++i]);
+        else if(arg == "--pop-sigma" && i + 1 < argc) spec.pop_sigma = atof(argv[++i]);
+        else if(arg == "--seed" && i + 1 < argc) spec.seed = atoi(argv[++i]);
+        else if(arg == "--template" && i + 1 < argc) spec.template_dir = argv[++i];
+        else if(arg == "--no-distances") spec.euclid_file = spec.road_file = false;
+        else{
+            cout << "Unknown option: " << arg << endl;
+            return 1;
+        }
+    }
+    if(out_dir.empty()){
+        cout << "Usage: make_synthetic --out <dir> [--groups G] [--population N] [--layout uniform|clustered|grid]" << endl;
+        return 1;
+    }
+    if(out_dir.back() != '/') out_dir += "/";
+
+    write_synthetic_scale(spec, out_dir);
+    cout << "Wrote " << spec.groups << " groups (" << spec.population << " people, " << spec.layout
+         << " layout) to " << out_dir << endl;
+    return 0;
+}
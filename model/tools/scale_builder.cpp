@@ -0,0 +1,302 @@
+#include "scale_builder.h"
+#include "synth.h"
+#include "../params.h"
+#include "../table.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <zlib.h>
+
+using namespace std;
+
+// UTM zone 2S, less the south-west corner of the villages (see README and
+// data/villages_lat_lon.csv), so X and Y are metres like the other scales
+constexpr int    UTM_ZONE  = 2;
+constexpr double ORIGIN_E  = 518002.3054;
+constexpr double ORIGIN_N  = 8412742.711;
+
+[[noreturn]] static void fail(const string& file, const string& msg){
+    cout << file << ": " << msg << endl;
+    exit(1);
+}
+
+//WGS84 latitude/longitude (degrees) to southern-hemisphere UTM, the series in Snyder (1987)
+static void to_utm(double lat, double lon, double& east, double& north){
+    const double a = 6378137, f = 1/298.257223563, k0 = 0.9996;
+    const double e2 = f*(2 - f), e4 = e2*e2, e6 = e4*e2, ep2 = e2/(1 - e2);
+    double phi = lat*M_PI/180, lam = (lon - (6*UTM_ZONE - 183))*M_PI/180;
+
+    double s = sin(phi), c = cos(phi), t = tan(phi);
+    double N = a/sqrt(1 - e2*s*s), T = t*t, C = ep2*c*c, A = c*lam;
+    double M = a*((1 - e2/4 - 3*e4/64 - 5*e6/256)*phi - (3*e2/8 + 3*e4/32 + 45*e6/1024)*sin(2*phi)
+                  + (15*e4/256 + 45*e6/1024)*sin(4*phi) - (35*e6/3072)*sin(6*phi));
+
+    east = 500000 + k0*N*(A + (1 - T + C)*pow(A, 3)/6 + (5 - 18*T + T*T + 72*C - 58*ep2)*pow(A, 5)/120);
+    north = 10000000 + k0*(M + N*t*(A*A/2 + (5 - T + 9*C + 4*C*C)*pow(A, 4)/24
+                                    + (61 - 58*T + T*T + 600*C - 330*ep2)*pow(A, 6)/720));
+}
+
+// Just enough of TIFF for single-band population rasters: strips or tiles,
+// uncompressed or deflate, integer or float samples, georeferenced by a
+// transformation matrix or tie point and pixel scale, in lat/lon or UTM 2S.
+class GeoTiff{
+public:
+    int width = 0, height = 0;
+    vector<double> value;                   //row by row from the north, NaN where there is no data
+    vector<double> x, y;                    //model coordinates of the cell centres
+
+    GeoTiff(const string& path) : path(path), file(path){
+        if(!file.ok()) fail(path, "cannot open");
+        if(file.size() < 8 || (memcmp(file.data(), "MM\0*", 4) != 0 && memcmp(file.data(), "II*\0", 4) != 0)){
+            fail(path, "not a TIFF (BigTIFF is not read)");
+        }
+        big = file.data()[0] == 'M';
+        read_ifd(u32(4));
+        decode();
+        locate();
+    }
+
+private:
+    struct Entry{ uint16_t type; uint32_t count; size_t at; };
+
+    string path;
+    MappedFile file;
+    bool big;
+    map<int, Entry> tags;
+
+    uint64_t raw(size_t at, int bytes) const{
+        if(at + bytes > file.size()) fail(path, "truncated");
+        const unsigned char *p = (const unsigned char*)file.data() + at;
+        uint64_t v = 0;
+        for(int i = 0; i < bytes; ++i) v |= (uint64_t)p[big ? bytes - 1 - i : i] << (8*i);
+        return v;
+    }
+    uint32_t u32(size_t at) const { return raw(at, 4); }
+
+    void read_ifd(size_t at){
+        int n = raw(at, 2);
+        for(int i = 0; i < n; ++i){
+            size_t e = at + 2 + 12*i;
+            Entry entry{(uint16_t)raw(e + 2, 2), u32(e + 4), 0};
+            entry.at = type_size(entry.type)*entry.count <= 4 ? e + 8 : u32(e + 8);
+            tags[raw(e, 2)] = entry;
+        }
+    }
+
+    static int type_size(int type){
+        switch(type){
+            case 1: case 2: case 6: case 7: return 1;
+            case 3: case 8: return 2;
+            case 4: case 9: case 11: return 4;
+            case 5: case 10: case 12: return 8;
+        }
+        return 0;
+    }
+
+    //numeric tag as doubles (empty if missing)
+    vector<double> numbers(int tag) const{
+        map<int, Entry>::const_iterator it = tags.find(tag);
+        if(it == tags.end()) return {};
+        const Entry& e = it->second;
+        int sz = type_size(e.type);
+        vector<double> v(e.count);
+        for(uint32_t i = 0; i < e.count; ++i){
+            size_t at = e.at + (size_t)i*sz;
+            switch(e.type){
+                case 1: case 7: v[i] = raw(at, 1); break;
+                case 3: v[i] = raw(at, 2); break;
+                case 4: v[i] = u32(at); break;
+                case 5: v[i] = (double)u32(at)/u32(at + 4); break;
+                case 11: { uint32_t b = u32(at); float f; memcpy(&f, &b, 4); v[i] = f; } break;
+                case 12: { uint64_t b = raw(at, 8); double d; memcpy(&d, &b, 8); v[i] = d; } break;
+                default: fail(path, "tag " + to_string(tag) + " has an unsupported type");
+            }
+        }
+        return v;
+    }
+
+    double number(int tag, double missing) const{
+        vector<double> v = numbers(tag);
+        return v.empty() ? missing : v[0];
+    }
+
+    double sample(const unsigned char *p, int bytes, int format) const{
+        uint64_t v = 0;
+        for(int i = 0; i < bytes; ++i) v |= (uint64_t)p[big ? bytes - 1 - i : i] << (8*i);
+        if(format == 3){
+            if(bytes == 4){ uint32_t b = v; float f; memcpy(&f, &b, 4); return f; }
+            double d; memcpy(&d, &v, 8); return d;
+        }
+        if(format == 2) return (double)((int64_t)(v << (64 - 8*bytes)) >> (64 - 8*bytes)); //sign extended
+        return (double)v;
+    }
+
+    void decode(){
+        width = number(256, 0);
+        height = number(257, 0);
+        int bits = number(258, 0), format = number(339, 1), compression = number(259, 1);
+        if(number(277, 1) != 1) fail(path, "only single-band rasters are read");
+        if(number(317, 1) != 1) fail(path, "predictors are not read, save it without one");
+        if(compression != 1 && compression != 8 && compression != 32946) fail(path, "only uncompressed or deflate rasters are read");
+        if(bits % 8 != 0 || bits == 0 || bits > 64 || (format == 3 && bits != 32 && bits != 64)) fail(path, "unsupported sample type");
+        int bytes = bits/8;
+
+        //strips are tiles as wide as the image
+        bool tiled = tags.count(322) > 0;
+        int tile_w = tiled ? number(322, 0) : width;
+        int tile_h = tiled ? number(323, 0) : number(278, height);
+        vector<double> offsets = numbers(tiled ? 324 : 273), counts = numbers(tiled ? 325 : 279);
+        int across = (width + tile_w - 1)/tile_w;
+        if(width <= 0 || height <= 0 || offsets.size() != counts.size() || offsets.empty()) fail(path, "no image data");
+
+        double nodata = numeric_limits<double>::quiet_NaN();
+        map<int, Entry>::const_iterator nd = tags.find(42113);     //GDAL_NODATA, as text
+        if(nd != tags.end()) nodata = atof(string(file.data() + nd->second.at, nd->second.count).c_str());
+
+        value.assign((size_t)width*height, numeric_limits<double>::quiet_NaN());
+        vector<unsigned char> buf((size_t)tile_w*tile_h*bytes);
+        for(size_t t = 0; t < offsets.size(); ++t){
+            size_t at = offsets[t], n = counts[t];
+            if(at + n > file.size()) fail(path, "truncated");
+            uLongf len = buf.size();
+            if(compression == 1) memcpy(buf.data(), file.data() + at, min(n, buf.size()));
+            else if(uncompress(buf.data(), &len, (const Bytef*)file.data() + at, n) != Z_OK) fail(path, "bad deflate data");
+
+            int c0 = (t % across)*tile_w, r0 = (t / across)*tile_h;
+            for(int r = 0; r < tile_h && r0 + r < height; ++r){
+                for(int c = 0; c < tile_w && c0 + c < width; ++c){
+                    double v = sample(&buf[((size_t)r*tile_w + c)*bytes], bytes, format);
+                    if(v != nodata) value[(size_t)(r0 + r)*width + c0 + c] = v;
+                }
+            }
+        }
+    }
+
+    void locate(){
+        //geokeys: model type (1 projected, 2 geographic), raster type (2 pixel is point), projected CRS
+        map<int, int> keys;
+        vector<double> dir = numbers(34735);
+        for(size_t k = 4; k + 3 < dir.size(); k += 4) if(dir[k+1] == 0) keys[dir[k]] = dir[k+3];
+        bool geographic = keys.count(1024) == 0 || keys[1024] == 2;
+        if(!geographic && keys[3072] != 32700 + UTM_ZONE) fail(path, "must be in lat/lon or UTM zone 2S");
+        double half = keys.count(1025) && keys[1025] == 2 ? 0 : 0.5;
+
+        //pixel (column, row) to raster coordinates
+        double m[6];
+        vector<double> mt = numbers(34264), tie = numbers(33922), scale = numbers(33550);
+        if(mt.size() == 16){
+            m[0] = mt[0]; m[1] = mt[1]; m[2] = mt[3];
+            m[3] = mt[4]; m[4] = mt[5]; m[5] = mt[7];
+        }
+        else if(tie.size() >= 6 && scale.size() >= 2){
+            m[0] = scale[0]; m[1] = 0; m[2] = tie[3] - tie[0]*scale[0];
+            m[3] = 0; m[4] = -scale[1]; m[5] = tie[4] + tie[1]*scale[1];
+        }
+        else fail(path, "not georeferenced");
+
+        x.resize(value.size());
+        y.resize(value.size());
+        for(int r = 0; r < height; ++r){
+            for(int c = 0; c < width; ++c){
+                size_t i = (size_t)r*width + c;
+                double u = m[0]*(c + half) + m[1]*(r + half) + m[2];
+                double v = m[3]*(c + half) + m[4]*(r + half) + m[5];
+                if(geographic) to_utm(v, u, u, v);
+                x[i] = u - ORIGIN_E;
+                y[i] = v - ORIGIN_N;
+            }
+        }
+    }
+};
+
+ScalePoints raster_points(const string& tiff){
+    GeoTiff img(tiff);
+    ScalePoints pts;
+    for(size_t i = 0; i < img.value.size(); ++i){
+        if(!(img.value[i] > 0)) continue; //sea, no data or nobody
+        pts.x.push_back(img.x[i]);
+        pts.y.push_back(img.y[i]);
+        pts.w.push_back(img.value[i]);
+    }
+    return pts;
+}
+
+ScalePoints building_points(const string& csv, const string& weight){
+    if(weight != "count" && weight != "area"){
+        cout << "Unknown weight " << weight << " (options: count, area)" << endl;
+        exit(1);
+    }
+    Table bld(csv);
+    int x_col = bld.col("x"), y_col = bld.col("y"), area_col = weight == "area" ? bld.col("AREA_1") : -1;
+
+    ScalePoints pts;
+    for(int r = 0; r < bld.rows(); ++r){
+        pts.x.push_back(bld.num(r, x_col) - ORIGIN_E);
+        pts.y.push_back(bld.num(r, y_col) - ORIGIN_N);
+        pts.w.push_back(area_col < 0 ? 1 : bld.num(r, area_col));
+    }
+    return pts;
+}
+
+int write_binned_scale(const ScaleSpec& spec, const string& out_dir){
+    bool raster = spec.source == "raster";
+    if(!raster && spec.source != "buildings"){
+        cout << "Unknown source " << spec.source << " (options: raster, buildings)" << endl;
+        exit(1);
+    }
+    string input = spec.input.empty() ? (raster ? "../data/Rasters/am_samoa.tiff" : "../data/AS_BLD.csv") : spec.input;
+    ScalePoints pts = raster ? raster_points(input) : building_points(input, spec.weight);
+    if(pts.w.empty()) fail(input, "nobody in it");
+
+    //square cells on a grid from the origin, listed from the north-west like the Raster scales;
+    //a raster group sits at its cell's centre, buildings at the weighted mean of their footprints
+    vector<double> w, x, y;
+    if(spec.cell > 0){
+        map<pair<long, long>, int> cell_of;
+        for(size_t i = 0; i < pts.w.size(); ++i){
+            pair<long, long> key(-(long)floor(pts.y[i]/spec.cell), (long)floor(pts.x[i]/spec.cell));
+            map<pair<long, long>, int>::iterator it = cell_of.find(key);
+            if(it == cell_of.end()){
+                it = cell_of.insert(pair<pair<long, long>, int>(key, w.size())).first;
+
+                w.push_back(0);     x.push_back(0);     y.push_back(0);
+            }
+            w[it->second] += pts.w[i];
+            x[it->second] += pts.w[i]*pts.x[i];
+            y[it->second] += pts.w[i]*pts.y[i];
+        }
+        vector<double> sw, sx, sy;
+        for(map<pair<long, long>, int>::iterator it = cell_of.begin(); it != cell_of.end(); ++it){
+            int g = it->second;
+            sw.push_back(w[g]);
+            sx.push_back(raster ? (it->first.second + 0.5)*spec.cell : x[g]/w[g]);
+            sy.push_back(raster ? (-it->first.first + 0.5)*spec.cell : y[g]/w[g]);
+        }
+        w.swap(sw);     x.swap(sx);     y.swap(sy);
+    }
+    else{
+        w = pts.w;      x = pts.x;      y = pts.y;
+    }
+
+    //people in proportion, summing to the target; cells that round to nobody are left out
+    vector<long> rounded = round_to_total(w, spec.population, 0);
+    vector<long> pops;
+    vector<double> gx, gy;
+    for(size_t g = 0; g < rounded.size(); ++g){
+        if(rounded[g] == 0) continue;
+        pops.push_back(rounded[g]);
+        gx.push_back(x[g]);
+        gy.push_back(y[g]);
+    }
+
+    filesystem::create_directories(out_dir);
+    write_groups(out_dir, pops, gx, gy);
+    filesystem::remove(out_dir + CROW_DISTANCE);
+    filesystem::remove(out_dir + CAR_DISTANCE);
+    if(spec.euclid_file) write_distances(out_dir + CROW_DISTANCE, gx, gy, false);
+
+    return pops.size();
+}
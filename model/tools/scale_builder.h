@@ -0,0 +1,34 @@
+#ifndef scale_builder_h
+#define scale_builder_h
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Scale builder: bins population-raster cells (a GeoTIFF such as
+// data/Rasters/am_samoa.tiff) or building footprints (data/AS_BLD.csv) into
+// square groups of any size, in the model's coordinates (UTM zone 2S less the
+// village origin, see README), and writes groups.csv and euc_dist.csv like the
+// scales in data/Scales/, to run with --scale. Populations are scaled to the
+// village total and rounded so they sum to it exactly.
+struct ScaleSpec{
+    string source = "raster";       //raster or buildings
+    string input;                   //the GeoTIFF or footprint CSV (defaults to the data/ copies)
+    double cell = 220;              //side of a group (metres), 0 for one group per building or raster cell
+    long population = 54359;        //total population (Village and One)
+    string weight = "count";        //buildings: people in proportion to count or area of the footprints
+    bool euclid_file = true;        //write euc_dist.csv
+};
+
+struct ScalePoints{                 //people before binning, at model coordinates
+    vector<double> x, y, w;
+};
+
+ScalePoints raster_points(const string& tiff);                        //centre and value of every populated cell
+ScalePoints building_points(const string& csv, const string& weight);
+
+//returns the number of groups written
+int write_binned_scale(const ScaleSpec& spec, const string& out_dir);
+
+#endif /* scale_builder_h */
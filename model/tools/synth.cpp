@@ -0,0 +1,163 @@
+#include "synth.h"
+#include "../params.h"
+#include "../parallel.h"
+
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+
+using namespace std;
+
+static void place_groups(const SynthSpec& spec, mt19937& rng, vector<double>& x, vector<double>& y){
+    uniform_real_distribution<> unif(0.0, spec.extent);
+    x.resize(spec.groups);
+    y.resize(spec.groups);
+
+    if(spec.layout == "uniform"){
+        for(int i = 0; i < spec.groups; ++i){
+            x[i] = unif(rng);
+            y[i] = unif(rng);
+        }
+    }
+    else if(spec.layout == "grid"){ //raster cells, filled row by row
+        int side = ceil(sqrt((double)spec.groups));
+        double cell = spec.extent / side;
+        for(int i = 0; i < spec.groups; ++i){
+            x[i] = (i % side + 0.5) * cell;
+            y[i] = (i / side + 0.5) * cell;
+        }
+    }
+    else if(spec.layout == "clustered"){ //groups scattered around island centres
+        vector<double> cx(spec.islands), cy(spec.islands);
+        for(int k = 0; k < spec.islands; ++k){
+            cx[k] = unif(rng);
+            cy[k] = unif(rng);
+        }
+        normal_distribution<> spread(0.0, spec.extent / (8.0 * sqrt((double)spec.islands)));
+        uniform_int_distribution<> island(0, spec.islands - 1);
+        for(int i = 0; i < spec.groups; ++i){
+            int k = island(rng);
+            x[i] = min(max(cx[k] + spread(rng), 0.0), spec.extent);
+            y[i] = min(max(cy[k] + spread(rng), 0.0), spec.extent);
+        }
+    }
+    else{
+        cout << "Unknown layout " << spec.layout << " (options: uniform, clustered, grid)" << endl;
+        exit(1);
+    }
+}
+
+//lognormal group sizes, rounded so they sum to the target with at least one person per group
+static vector<long> group_sizes(const SynthSpec& spec, mt19937& rng){
+    if(spec.population < spec.groups){
+        cout << "Population must be at least the number of groups" << endl;
+        exit(1);
+    }
+    lognormal_distribution<> size(0.0, spec.pop_sigma);
+    vector<double> w(spec.groups);
+    for(int i = 0; i < spec.groups; ++i) w[i] = size(rng);
+
+    return round_to_total(w, spec.population, 1);
+}
+
+vector<long> round_to_total(const vector<double>& w, long total, long at_least){
+    int n = w.size();
+    double sum = 0;
+    for(int i = 0; i < n; ++i) sum += w[i];
+
+    long spare = total - at_least*n;
+    vector<long> pops(n);
+    vector<pair<double, int>> remainder(n);
+    long assigned = 0;
+    for(int i = 0; i < n; ++i){
+        double share = spare * w[i] / sum;
+        pops[i] = at_least + (long)share;
+        assigned += (long)share;
+        remainder[i] = pair<double, int>(share - floor(share), i);
+    }
+    sort(remainder.begin(), remainder.end(), greater<pair<double, int>>());
+    for(long i = 0; i < spare - assigned; ++i) ++pops[remainder[i].second]; //largest remainders
+
+    return pops;
+}
+
+void write_groups(const string& out_dir, const vector<long>& pops, const vector<double>& x, const vector<double>& y){
+    ofstream out(out_dir + GROUP_DATA);
+    out << "Group,Population,X,Y" << endl;
+    out << setprecision(12);
+    for(size_t i = 0; i < pops.size(); ++i){
+        out << i + 1 << "," << pops[i] << "," << x[i] << "," << y[i] << endl;
+    }
+}
+
+void copy_shared_inputs(const string& template_dir, const string& out_dir){
+    //shared inputs are the real ones, so demography and transmission match the fitted model
+    const vector<string> shared {AGE_BRACKETS, BIRTH_FILE, MORTALITY_FILE, EXPOSURE_AGE,
+                                 TRAN_PARAM, INIT_PARAMS, MDA_PARAMS, "initaggs.csv"};
+    for(const string& f : shared){
+        filesystem::copy_file(template_dir + f, out_dir + f, filesystem::copy_options::overwrite_existing);
+    }
+}
+
+void write_distances(const string& filename, const vector<double>& x, const vector<double>& y, bool l1){
+    FILE *out = fopen(filename.c_str(), "w");
+    if(!out){
+        cout << "open " << filename << " failed" << endl;
+        exit(1);
+    }
+
+    int n = x.size();
+    fputs("X", out);
+    for(int j = 0; j < n; ++j) fprintf(out, ",%d", j + 1);
+    fputc('\n', out);
+
+    //distances are whole metres like the real scales. Blocks of rows are worked out on every
+    //core (each row a branch-free loop over the coordinates, vectorised at -O3) and written in order
+    const int block = 256;
+    vector<vector<char>> rows(block);
+    for(int first = 0; first < n; first += block){
+        int count = min(block, n - first);
+        parallel_for(count, 0, [&](int r){
+            int i = first + r;
+            const double *xs = x.data(), *ys = y.data();
+            double xi = x[i], yi = y[i];
+            vector<double> d(n);
+            if(l1) for(int j = 0; j < n; ++j) d[j] = fabs(xi - xs[j]) + fabs(yi - ys[j]);
+            else for(int j = 0; j < n; ++j) d[j] = sqrt((xi - xs[j])*(xi - xs[j]) + (yi - ys[j])*(yi - ys[j]));
+
+            vector<char>& row = rows[r];
+            row.resize((size_t)(n + 1) * 12);
+            char *p = row.data();
+            p = to_chars(p, p + 12, i + 1).ptr;
+            for(int j = 0; j < n; ++j){
+                *p++ = ',';
+                p = to_chars(p, p + 12, lround(d[j])).ptr;
+            }
+            *p++ = '\n';
+            row.resize(p - row.data());
+        });
+        for(int r = 0; r < count; ++r) fwrite(rows[r].data(), 1, rows[r].size(), out);
+    }
+    fclose(out);
+}
+
+void write_synthetic_scale(const SynthSpec& spec, const string& out_dir){
+    filesystem::create_directories(out_dir);
+    mt19937 rng(spec.seed);
+
+    vector<double> x, y;
+    place_groups(spec, rng, x, y);
+    vector<long> pops = group_sizes(spec, rng);
+    write_groups(out_dir, pops, x, y);
+
+    filesystem::remove(out_dir + CROW_DISTANCE);
+    filesystem::remove(out_dir + CAR_DISTANCE);
+    if(spec.euclid_file) write_distances(out_dir + CROW_DISTANCE, x, y, false);
+    if(spec.road_file) write_distances(out_dir + CAR_DISTANCE, x, y, true);
+    copy_shared_inputs(spec.template_dir, out_dir);
+
+    ofstream out(out_dir + "current_scale.txt");
+
+    out << "Synthetic_" << spec.layout << "_" << spec.groups << "g_" << spec.population << "p" << endl;
+    out.close();
+}
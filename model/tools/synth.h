@@ -0,0 +1,36 @@
+#ifndef synth_h
+#define synth_h
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Synthetic scale generator: writes groups.csv (and optionally the distance
+// matrices) for a made-up island group, plus copies of the shared inputs
+// (age distribution, birth/mortality/exposure rates, TranParams, InitParams,
+// MDAParams, initaggs) so the output directory can be used as both the data
+// and scale directory of a Region.
+struct SynthSpec{
+    int groups = 1000;              //number of groups
+    long population = 200000;       //total population (split over groups)
+    string layout = "clustered";    //uniform, clustered (islands) or grid (raster-like)
+    int islands = 5;                //number of clusters for the clustered layout
+    double extent = 50000;          //side of the square region (metres)
+    double pop_sigma = 1.0;         //sd of log group size (0 = equal sized groups)
+    unsigned seed = 1;
+    bool euclid_file = true;        //write euc_dist.csv
+    bool road_file = true;          //write road_dist.csv (L1 distance)
+    string template_dir = "../data/"; //where the shared inputs are copied from
+};
+
+void write_synthetic_scale(const SynthSpec& spec, const string& out_dir);
+
+// Pieces of a scale directory, shared with make_scale.
+vector<long> round_to_total(const vector<double>& w, long total, long at_least);    //largest remainders, each at least at_least
+void write_groups(const string& out_dir, const vector<long>& pops, const vector<double>& x, const vector<double>& y);
+void write_distances(const string& filename, const vector<double>& x, const vector<double>& y, bool l1);
+void copy_shared_inputs(const string& template_dir, const string& out_dir);
+
+
+#endif /* synth_h */
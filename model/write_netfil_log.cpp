@@ -1,4 +1,5 @@
 #include "write_netfil_log.h"
+#include "rng.h"
 #include <iostream>
 #include <fstream>
 #include <ctime>
@@ -21,7 +22,10 @@ void write_netfil(
     time_t start_time,
     time_t end_time,
     Region *rgn,
-    string mda_data
+    string mda_data,
+    const Profile& setup_profile,
+    const vector<Profile>& scenario_profiles,
+    const vector<ScenarioRun>& scenario_runs
 ) {
     string basename = filename;
     if (basename.size() >= 4 && basename.substr(basename.size() - 4) == ".csv") {
@@ -44,12 +48,18 @@ void write_netfil(
 
     write_section(netfil, "Parameters of last simulation number");
     
-    // Outputs the scale of whichever make_<>.sh file was run most recently
-    ifstream scale_file(string(DATADIR) + "current_scale.txt");
-    string current_scale;
-    getline(scale_file, current_scale);
-    scale_file.close();
+    // Outputs --scale, or the scale of whichever make_<>.sh file was run most recently
+    string current_scale = filesystem::path(rgn->scale_dir).parent_path().filename().string();
+    if(rgn->scale_dir == DATADIR){
+        ifstream scale_file(string(DATADIR) + "current_scale.txt");
+        getline(scale_file, current_scale);
+        scale_file.close();
+    }
     write_value(netfil, "Scale", current_scale);
+    write_value(netfil, "Scale folder", rgn->scale_dir);
+    write_value(netfil, "Transmission parameters", rgn->tran_file);
+    write_value(netfil, "MDA parameters", mda_data);
+
     write_value(netfil, "No. of groups", rgn->group_blocks);
 
     write_value(netfil, "Region name", rgn->rname);
@@ -66,12 +76,30 @@ void write_netfil(
     write_section(netfil, "MDA parameters");
     int num_scenarios = count_mda_scenarios(mda_data);
     for (int i = 1; i <= num_scenarios; i++) {
-        MDAStrat strategy = get_mda_strat(mda_data, i + 1);
+        MDAStrat strategy = get_mda_strat(mda_data, i); // skips the header plus i-1 scenarios
         write_value(netfil, "Strategy number", i);
         strategy.print_mda_strat(netfil);
+        if (i <= (int)scenario_runs.size()) {
+            const ScenarioRun& run = scenario_runs[i - 1];
+            write_value(netfil, "Replicates run", run.n);
+            write_value(netfil, "Final-year elimination probability (95% CI half-width)",
+                        to_string(run.elim()) + " (" + to_string(run.elim_half()) + ")");
+            write_value(netfil, "Final-year mean mf prevalence (95% CI half-width)",
+                        to_string(run.prev()) + " (" + to_string(run.prev_half()) + ")");
+        }
         netfil << endl;
     }
 
+    write_section(netfil, "Random numbers");
+    write_value(netfil, "Base seed (rerun with --seed)", base_seed);
+    write_value(netfil, "Common random numbers across scenarios (--crn)", crn ? "yes" : "no");
+    write_value(netfil, "Parameters set at run time (--set)", rgn->settings.empty() ? "none" : rgn->settings);
+    if (STOP_ELIM_WIDTH > 0 || STOP_PREV_WIDTH > 0) {
+        write_value(netfil, "Stop at elimination probability half-width (0 not used)", STOP_ELIM_WIDTH);
+        write_value(netfil, "Stop at mf prevalence half-width (0 not used)", STOP_PREV_WIDTH);
+        write_value(netfil, "Fewest replicates before stopping", STOP_MIN_SIMS);
+    }
+
     write_section(netfil, "Year parameters");
     write_value(netfil, "Starting year of simulation",  START_YEAR);
     write_value(netfil, "Ending year of simulation", START_YEAR+SIM_YEARS);
@@ -105,7 +133,24 @@ void write_netfil(
     write_value(netfil, "Sigma_g (household stdev)", SIGMA_G);
     write_value(netfil, "Beta_0", BETA_0);
     write_value(netfil, "Distance type (e euclidean, r road)", DISTANCE_TYPE);
+    if (SPARSE_COMMUTE) {
+        write_value(netfil, "Commuting to nearest groups only (0 all)", COMMUTE_K);
+        write_value(netfil, "Commuting distance cutoff (0 none)", COMMUTE_CUTOFF);
+    }
     write_value(netfil, "Number of years till road network re-estimated", RECALC_YEARS);
+    write_value(netfil, "After elimination (c cohorts, s stop, else agents)", ELIM_FAST_FORWARD);
+    write_value(netfil, "Hybrid population (uninfected held as counts)", HYBRID_POP ? "yes" : "no");
+    if (HYBRID_POP) {
+        write_value(netfil, "Pooled age bracket (days)", POOL_AGE_WIDTH);
+        write_value(netfil, "Pooled bite scale bins", POOL_BITE_BINS);
+    }
+    write_value(netfil, "Stepped as spatial partitions (0 whole)", STEP_PARTITIONS);
+    write_value(netfil, "Replayed demographies (0 live)", DEMOG_REPLAYS);
+    if (rgn->epi_tol > 0) {
+        write_value(netfil, "Adaptive epi step tolerance (--epi-tol)", rgn->epi_tol);
+        write_value(netfil, "Epi step range (days)", to_string(EPI_DT_MIN) + "-" + to_string(EPI_DT_MAX));
+    }
+    else write_value(netfil, "Epi step (days)", EPI_DT);
        
     write_section(netfil, "TIMESTAMP");
     int duration = (int)difftime(end_time, start_time);
@@ -117,5 +162,23 @@ void write_netfil(
     netfil << "Time taken (h:m:s): " << duration_h << ":" <<
         duration_min << ":" << duration_sec << endl;
 
+    if (profiling) {
+        write_section(netfil, "PROFILE");
+        if (perf_events_available()) {
+            netfil << "Hardware counters: cycles and cache misses from perf_event_open" << endl;
+        }
+        netfil << "Phase times are inclusive (radt_model is inside handle_commute)" << endl << endl;
+        setup_profile.write_table(netfil);
+        for (const Profile& p : scenario_profiles) {
+            netfil << endl;
+            p.write_table(netfil);
+        }
+
+        string json_name = basename + ".profile.json";
+        write_profile_json(json_name, setup_profile, scenario_profiles);
+        netfil << endl;
+        write_value(netfil, "Profile JSON", filesystem::path(json_name).filename().string());
+    }
+
     netfil.close();
 }
@@ -1,10 +1,15 @@
 #include <ctime>
 #include "network.h"
+#include "profile.h"
+#include "campaign.h"
 
 void write_netfil(
     const string& filename,
     time_t start_time,
     time_t end_time,
     Region *rgn,
-    string mda_data
+    string mda_data,
+    const Profile& setup_profile,
+    const vector<Profile>& scenario_profiles,
+    const vector<ScenarioRun>& scenario_runs
 );
\ No newline at end of file